@@ -1,9 +1,15 @@
 #include "Fan.hpp"
 
-Fan::Fan(){}
+Fan::Fan()
+: _started(0), _kicking(false), _kickStarted(0), _stalled(false), _kicks(0),
+_stallCount(0), _kickCount(0), _lastStall(0)
+{
+}
 
 Fan::Fan(int pin, int frequency, int dutyCycle)
-: _pin(pin), _frequency(frequency), _dutyCycle(dutyCycle)
+: _pin(pin), _frequency(frequency), _dutyCycle(dutyCycle),
+_started(0), _kicking(false), _kickStarted(0), _stalled(false), _kicks(0),
+_stallCount(0), _kickCount(0), _lastStall(0)
 {
 }
 
@@ -13,10 +19,11 @@ Fan::~Fan()
 }
 
 /**
-	Initalizes fan pin frequency and dutycycle.
+	Initalizes fan pin frequency, ramp and dutycycle.
 */
 void Fan::init()
 {
+	_ramp.begin(_pin);
 	setFrequency(_frequency);
 	setDutyCycle(_dutyCycle);
 }
@@ -38,7 +45,10 @@ bool Fan::setFrequency(int frequency)
 
 /**
 	Sets new dutycycle. Checks validity of the new dutyucycle first.
-	If 0 < dutyCycle < MIN_DUTYCYCLE, _dutyCycle = MIN_DUTYCYCLE.
+	If 0 < dutyCycle < MIN_DUTYCYCLE and the fan has no tachometer, _dutyCycle = MIN_DUTYCYCLE.
+	Fans with a tachometer can run at any dutycycle, as they are kicked if they stall.
+	The output is ramped to the new dutycycle with the slew rate of the fan.
+	During a kick the new dutycycle is applied when the kick ends.
 
 
 	@param dutycycle: new dutycycle
@@ -47,20 +57,83 @@ bool Fan::setFrequency(int frequency)
 bool Fan::setDutyCycle(int dutyCycle)
 {
 	if (dutyCycle < 101 && dutyCycle > -1) {
-		if (dutyCycle == 0) {
-			pwmWrite(_pin, 0);
-		} else if (dutyCycle < MIN_DUTYCYCLE) {
-			pwmWrite(_pin, map(MIN_DUTYCYCLE, 0, 100, 0, 255));
+		if (dutyCycle > 0 && dutyCycle < MIN_DUTYCYCLE && !_tachometer.isActive()) {
 			dutyCycle = MIN_DUTYCYCLE;
-		} else {
-			pwmWrite(_pin, map(dutyCycle, 0, 100, 0, 255));
 		}
+		if (_dutyCycle == 0 && dutyCycle > 0) _started = millis();
 		_dutyCycle = dutyCycle;
+		if (!_kicking) writeDutyCycle();
 		return true;
 	}
 	return false;
 }
 
+/**
+	@param slewRate: Dutycycle percent per second, 0 to change dutycycle at once
+	@return True if the slew rate was successfully changed, otherwise false.
+*/
+bool Fan::setSlewRate(int slewRate)
+{
+	return _ramp.setSlewRate(slewRate);
+}
+
+/**
+	Writes _dutyCycle to the output. Before init the output is written directly.
+*/
+void Fan::writeDutyCycle()
+{
+	uint8_t value = map(_dutyCycle, 0, 100, 0, 255);
+	if (_ramp.isActive()) {
+		_ramp.write(value);
+	} else {
+		pwmWrite(_pin, value);
+	}
+}
+
+/**
+	Detects stalled rotor from the tachometer and kicks the fan. The fan is stalled
+	if the tachometer has seen no pulses for a whole window while the fan has been
+	running for STALL_TIMEOUT. A stalled fan is run at full dutycycle for KICK_DURATION
+	and then returned to its dutycycle. After MAX_KICKS the fan is left stalled until
+	it turns again or it is stopped. The kick is applied at once and the fan ramps
+	back to its dutycycle. Intended to call from the main-loop.
+*/
+void Fan::checkStall()
+{
+	if (_kicking) {
+		if (millis() - _kickStarted < KICK_DURATION) return;
+		_kicking = false;
+		_started = millis();
+		writeDutyCycle();
+		return;
+	}
+
+	if (_dutyCycle == 0 || !_tachometer.isReady() || _tachometer.getRpm() > 0) {
+		_stalled = false;
+		_kicks = 0;
+		return;
+	}
+	//Fan may not turn before the ramp has reached its dutycycle
+	if (_ramp.isRamping()) {
+		_started = millis();
+		return;
+	}
+	if (millis() - _started < STALL_TIMEOUT) return;
+
+	if (!_stalled) {
+		_stalled = true;
+		_stallCount++;
+		_lastStall = millis();
+	}
+	if (_kicks < MAX_KICKS) {
+		_kicks++;
+		_kickCount++;
+		_kicking = true;
+		_kickStarted = millis();
+		_ramp.jump(255);
+	}
+}
+
 int Fan::getPin()
 {
 	return _pin;
@@ -75,3 +148,60 @@ int Fan::getDutycycle()
 {
 	return _dutyCycle;
 }
+
+/**
+	@return Dutycycle of the output, differs from getDutycycle while ramping or kicking
+*/
+int Fan::getCurrentDutycycle()
+{
+	if (!_ramp.isActive()) return _dutyCycle;
+	return ((int)_ramp.getValue() * 100 + 127) / 255;
+}
+
+FanController& Fan::getController()
+{
+	return _controller;
+}
+
+Tachometer& Fan::getTachometer()
+{
+	return _tachometer;
+}
+
+SpeedController& Fan::getSpeedController()
+{
+	return _speedController;
+}
+
+PwmRamp& Fan::getRamp()
+{
+	return _ramp;
+}
+
+bool Fan::isKicking()
+{
+	return _kicking;
+}
+
+bool Fan::isStalled()
+{
+	return _stalled;
+}
+
+unsigned int Fan::getStallCount()
+{
+	return _stallCount;
+}
+
+unsigned int Fan::getKickCount()
+{
+	return _kickCount;
+}
+
+/**
+	@return millis() when the fan last stalled
+*/
+unsigned long Fan::getLastStall()
+{
+	return _lastStall;
+}
@@ -6,14 +6,33 @@
 #define MIN_DUTYCYCLE 15
 #define DEFAULT_FREQUENCY 25000
 #define DEFAULT_DUTYCYCLE 15
+#define STALL_TIMEOUT 3000 //ms a fan may run without tachometer pulses after starting
+#define KICK_DURATION 1000 //ms a stalled fan is run at full dutycycle
+#define MAX_KICKS 3 //Kicks per stall before the fan is left stalled
 
 #include "PWM.h"
+#include "FanController.hpp"
+#include "Tachometer.hpp"
+#include "SpeedController.hpp"
+#include "PwmRamp.hpp"
 
 class Fan {
 private:
 	int _pin;
 	int _frequency;
 	int _dutyCycle;
+	FanController _controller;
+	Tachometer _tachometer;
+	SpeedController _speedController;
+	PwmRamp _ramp;
+	unsigned long _started; //millis() when the fan was started or a kick ended
+	bool _kicking;
+	unsigned long _kickStarted;
+	bool _stalled;
+	uint8_t _kicks; //Kicks during the current stall
+	uint16_t _stallCount;
+	uint16_t _kickCount;
+	unsigned long _lastStall;
 
 public:
 
@@ -24,10 +43,25 @@ public:
 	void init();
 	bool setFrequency(int frequency);
 	bool setDutyCycle(int dutyCycle);
+	void checkStall();
+	bool setSlewRate(int slewRate);
 
 	int getPin();
 	int getFrequency();
 	int getDutycycle();
+	int getCurrentDutycycle();
+	FanController& getController();
+	Tachometer& getTachometer();
+	SpeedController& getSpeedController();
+	PwmRamp& getRamp();
+	bool isKicking();
+	bool isStalled();
+	unsigned int getStallCount();
+	unsigned int getKickCount();
+	unsigned long getLastStall();
+
+private:
+	void writeDutyCycle();
 };
 
 #endif
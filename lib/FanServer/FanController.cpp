@@ -0,0 +1,353 @@
+#include "FanController.hpp"
+
+#define RAW_PER_DEGREE 128
+#define GAIN_SCALE 100
+#define OUTPUT_SCALE ((long)GAIN_SCALE * RAW_PER_DEGREE) //Output units per dutycycle percent
+#define MAX_RATE (100L * RAW_PER_DEGREE) //Limits the derivative of readings taken close together
+
+FanController::FanController()
+: _sensors{}, _sensorCount(0), _enabled(false), _mode(ControlMode::PID), _target(DEFAULT_CONTROL_TARGET),
+_kp(DEFAULT_KP), _ki(DEFAULT_KI), _kd(DEFAULT_KD),
+_minDutyCycle(DEFAULT_CONTROL_MIN), _maxDutyCycle(DEFAULT_CONTROL_MAX),
+_integral(0), _hasInput(false), _input(0), _readTime(0), _rate(0),
+_curve{}, _curvePointCount(0), _hysteresis(DEFAULT_HYSTERESIS), _curveInput(0), _output(0)
+{
+}
+
+/**
+	Binds sensor to the controller. The hottest of the bound sensors is controlled.
+
+	@param address: Address of the sensor
+	@return false if all sensor slots are in use, true if bound or already bound
+*/
+bool FanController::bind(const uint8_t* address)
+{
+	for (uint8_t i=0; i<_sensorCount; i++) {
+		if (memcmp(_sensors[i], address, sizeof(DeviceAddress)) == 0) return true;
+	}
+	if (_sensorCount >= MAX_CONTROL_SENSORS) return false;
+
+	memcpy(_sensors[_sensorCount++], address, sizeof(DeviceAddress));
+	return true;
+}
+
+/**
+	Removes sensor binding.
+
+	@param index: Index of the sensor, from 0 to getSensorCount() - 1
+*/
+void FanController::unbind(uint8_t index)
+{
+	if (index >= _sensorCount) return;
+	for (uint8_t i=index; i<_sensorCount - 1; i++) {
+		memcpy(_sensors[i], _sensors[i + 1], sizeof(DeviceAddress));
+	}
+	_sensorCount--;
+}
+
+uint8_t FanController::getSensorCount() const
+{
+	return _sensorCount;
+}
+
+const uint8_t* FanController::getSensor(uint8_t index) const
+{
+	return _sensors[index];
+}
+
+/**
+	Enables control or changes its mode. The integral starts from the current
+	dutycycle, so the fan does not jump when PID control takes over.
+
+	@param mode: PID or fan curve
+	@param dutyCycle: Current dutycycle of the fan
+*/
+void FanController::enable(ControlMode mode, int dutyCycle)
+{
+	if (_enabled && _mode == mode) return;
+	_mode = mode;
+	_output = dutyCycle;
+	_integral = constrain(dutyCycle, _minDutyCycle, _maxDutyCycle) * OUTPUT_SCALE;
+	_hasInput = false;
+	_rate = 0;
+	_enabled = true;
+}
+
+void FanController::disable()
+{
+	_enabled = false;
+}
+
+bool FanController::isEnabled() const
+{
+	return _enabled;
+}
+
+ControlMode FanController::getMode() const
+{
+	return _mode;
+}
+
+/**
+	@param target: Target temperature in tenths of a degree
+	@return false if target is out of range
+*/
+bool FanController::setTarget(int target)
+{
+	if (target < MIN_CONTROL_TARGET || target > MAX_CONTROL_TARGET) return false;
+	_target = target;
+	return true;
+}
+
+/**
+	@param kp: Proportional gain
+	@param ki: Integral gain
+	@param kd: Derivative gain
+	@return false if a gain is out of range, then no gain is changed
+*/
+bool FanController::setGains(int kp, int ki, int kd)
+{
+	if (kp < 0 || kp > MAX_CONTROL_GAIN || ki < 0 || ki > MAX_CONTROL_GAIN || kd < 0 || kd > MAX_CONTROL_GAIN) {
+		return false;
+	}
+	_kp = kp;
+	_ki = ki;
+	_kd = kd;
+	return true;
+}
+
+/**
+	Sets the dutycycle range the controller may use.
+
+	@param minDutyCycle: Lowest dutycycle
+	@param maxDutyCycle: Highest dutycycle, also used when no sensor has a reading
+	@return false if the limits are invalid
+*/
+bool FanController::setLimits(int minDutyCycle, int maxDutyCycle)
+{
+	if (minDutyCycle < 0 || maxDutyCycle > 100 || minDutyCycle > maxDutyCycle) return false;
+	_minDutyCycle = minDutyCycle;
+	_maxDutyCycle = maxDutyCycle;
+	_integral = constrain(_integral, _minDutyCycle * OUTPUT_SCALE, _maxDutyCycle * OUTPUT_SCALE);
+	return true;
+}
+
+/**
+	Sets points of the fan curve. Temperatures of the points must be increasing.
+
+	@param points: New points
+	@param count: Number of new points
+	@param append: true to add the points after the current points, false to replace them
+	@return false if the points are invalid or do not fit, then the curve is not changed
+*/
+bool FanController::setCurve(const CurvePoint points[], uint8_t count, bool append)
+{
+	if (!isValidCurve(points, count, append)) return false;
+
+	uint8_t start = append ? _curvePointCount : 0;
+	memcpy(&_curve[start], points, count * sizeof(CurvePoint));
+	_curvePointCount = start + count;
+	_hasInput = false;
+	return true;
+}
+
+/**
+	Checks points without changing the curve.
+
+	@param points: Points in ascending order of temperature
+	@param count: Number of points
+	@param append: True if the points are added after the current ones
+	@return false if the points are invalid or do not fit
+*/
+bool FanController::isValidCurve(const CurvePoint points[], uint8_t count, bool append) const
+{
+	uint8_t start = append ? _curvePointCount : 0;
+	if (start + count > MAX_CURVE_POINTS) return false;
+
+	for (uint8_t i=0; i<count; i++) {
+		const CurvePoint* previous = i > 0 ? &points[i - 1] : (start > 0 ? &_curve[start - 1] : nullptr);
+		if (points[i].dutyCycle > 100 || (previous && points[i].temperature <= previous->temperature)) return false;
+	}
+	return true;
+}
+
+/**
+	@param hysteresis: Tenths of a degree the temperature must fall before the curve lowers the dutycycle
+	@return false if hysteresis is out of range
+*/
+bool FanController::setHysteresis(int hysteresis)
+{
+	if (hysteresis < 0 || hysteresis > MAX_HYSTERESIS) return false;
+	_hysteresis = hysteresis;
+	return true;
+}
+
+/**
+	Computes new dutycycle with the enabled mode. Called every CONTROL_INTERVAL ms
+	with cached readings.
+
+	@param temperature: Raw temperature of the hottest bound sensor
+	@param readTime: millis() when the temperature was read
+	@return Dutycycle from the minimum to the maximum limit
+*/
+int FanController::update(int16_t temperature, unsigned long readTime)
+{
+	if (_mode == ControlMode::CURVE) return updateCurve(temperature, readTime);
+	return updatePid(temperature, readTime);
+}
+
+/**
+	Computes new dutycycle with PID. The derivative is taken between read times
+	instead of between updates. The integral is limited to the dutycycle range to avoid windup.
+
+	@param temperature: Raw temperature of the hottest bound sensor
+	@param readTime: millis() when the temperature was read
+	@return Dutycycle from the minimum to the maximum limit
+*/
+int FanController::updatePid(int16_t temperature, unsigned long readTime)
+{
+	long error = temperature - (long)_target * RAW_PER_DEGREE / 10;
+
+	if (_hasInput && readTime != _readTime) {
+		_rate = (long)(temperature - _input) * 1000 / (long)(readTime - _readTime);
+		_rate = constrain(_rate, -MAX_RATE, MAX_RATE);
+	}
+	_hasInput = true;
+	_input = temperature;
+	_readTime = readTime;
+
+	_integral += _ki * (error * CONTROL_INTERVAL / 1000);
+	_integral = constrain(_integral, _minDutyCycle * OUTPUT_SCALE, _maxDutyCycle * OUTPUT_SCALE);
+
+	long output = _kp * error + _integral + _kd * _rate;
+	output = (output + OUTPUT_SCALE / 2) / OUTPUT_SCALE;
+	return constrain(output, _minDutyCycle, _maxDutyCycle);
+}
+
+/**
+	Evaluates the fan curve when a new reading has arrived, otherwise keeps the
+	dutycycle. A rising temperature is followed right away, but the dutycycle is
+	lowered only after the temperature has fallen by the hysteresis, so the fan
+	does not hunt around a point of the curve.
+
+	@param temperature: Raw temperature of the hottest bound sensor
+	@param readTime: millis() when the temperature was read
+	@return Dutycycle from the minimum to the maximum limit
+*/
+int FanController::updateCurve(int16_t temperature, unsigned long readTime)
+{
+	if (_hasInput && readTime == _readTime) return _output;
+
+	int16_t hysteresis = (long)_hysteresis * RAW_PER_DEGREE / 10;
+	if (!_hasInput || temperature > _curveInput) {
+		_curveInput = temperature;
+	} else if (temperature < _curveInput - hysteresis) {
+		_curveInput = temperature + hysteresis;
+	}
+	_hasInput = true;
+	_input = temperature;
+	_readTime = readTime;
+
+	_output = constrain(interpolate(_curveInput), _minDutyCycle, _maxDutyCycle);
+	return _output;
+}
+
+/**
+	Interpolates dutycycle linearly between the curve points around the temperature.
+	Below the first point the dutycycle of the first point is used and above the
+	last point the dutycycle of the last point.
+
+	@param temperature: Raw temperature
+	@return Dutycycle, maximum limit if the curve has no points
+*/
+int FanController::interpolate(int16_t temperature) const
+{
+	if (_curvePointCount == 0) return _maxDutyCycle;
+
+	long previous = (long)_curve[0].temperature * RAW_PER_DEGREE / 10;
+	if (temperature <= previous) return _curve[0].dutyCycle;
+
+	for (uint8_t i=1; i<_curvePointCount; i++) {
+		long next = (long)_curve[i].temperature * RAW_PER_DEGREE / 10;
+		if (temperature <= next) {
+			long from = _curve[i - 1].dutyCycle, to = _curve[i].dutyCycle;
+			return from + (to - from) * (temperature - previous) / (next - previous);
+		}
+		previous = next;
+	}
+	return _curve[_curvePointCount - 1].dutyCycle;
+}
+
+/**
+	Called instead of update when no bound sensor has a reading. Cooling is kept
+	on at the maximum dutycycle until readings return.
+
+	@return Maximum dutycycle
+*/
+int FanController::fail()
+{
+	_hasInput = false;
+	_rate = 0;
+	return _maxDutyCycle;
+}
+
+/**
+	@return Target temperature in tenths of a degree
+*/
+int FanController::getTarget() const
+{
+	return _target;
+}
+
+int FanController::getKp() const
+{
+	return _kp;
+}
+
+int FanController::getKi() const
+{
+	return _ki;
+}
+
+int FanController::getKd() const
+{
+	return _kd;
+}
+
+int FanController::getMinDutyCycle() const
+{
+	return _minDutyCycle;
+}
+
+int FanController::getMaxDutyCycle() const
+{
+	return _maxDutyCycle;
+}
+
+uint8_t FanController::getCurvePointCount() const
+{
+	return _curvePointCount;
+}
+
+const CurvePoint& FanController::getCurvePoint(uint8_t index) const
+{
+	return _curve[index];
+}
+
+int FanController::getHysteresis() const
+{
+	return _hysteresis;
+}
+
+bool FanController::hasInput() const
+{
+	return _hasInput;
+}
+
+/**
+	@return Raw temperature of the last update
+*/
+int16_t FanController::getInput() const
+{
+	return _input;
+}
@@ -0,0 +1,107 @@
+#ifndef FanController_h
+#define FanController_h
+
+#define MAX_CONTROL_SENSORS 2
+#define CONTROL_INTERVAL 1000 //ms between controller updates
+#define MAX_CONTROL_GAIN 10000 //Hundredths of dutycycle percent per degree
+#define MIN_CONTROL_TARGET 0 //Tenths of a degree
+#define MAX_CONTROL_TARGET 1000
+#define DEFAULT_CONTROL_TARGET 350
+#define DEFAULT_KP 1000
+#define DEFAULT_KI 10
+#define DEFAULT_KD 0
+#define DEFAULT_CONTROL_MIN 0
+#define DEFAULT_CONTROL_MAX 100
+#define MAX_CURVE_POINTS 8
+#define MIN_CURVE_TEMPERATURE -550 //Tenths of a degree
+#define MAX_CURVE_TEMPERATURE 1250
+#define MAX_HYSTERESIS 100 //Tenths of a degree
+#define DEFAULT_HYSTERESIS 20
+
+#include <DallasTemperature.h>
+
+enum class ControlMode : uint8_t
+{
+	PID,
+	CURVE
+};
+
+struct CurvePoint
+{
+	int16_t temperature; //Tenths of a degree
+	uint8_t dutyCycle;
+};
+
+/**
+	Controller computing the dutycycle of a fan from the temperatures of its sensors,
+	either with PID or with a piecewise-linear fan curve. PID gains are fixed-point
+	hundredths of dutycycle percent: kp per degree, ki per degree and second, kd per
+	degree per second. Temperatures are raw values in 1/128 degrees Celsius, so no
+	floating point is needed.
+*/
+class FanController
+{
+public:
+
+	FanController();
+
+	bool bind(const uint8_t* address);
+	void unbind(uint8_t index);
+	uint8_t getSensorCount() const;
+	const uint8_t* getSensor(uint8_t index) const;
+
+	void enable(ControlMode mode, int dutyCycle);
+	void disable();
+	bool isEnabled() const;
+	ControlMode getMode() const;
+	bool setTarget(int target);
+	bool setGains(int kp, int ki, int kd);
+	bool setLimits(int minDutyCycle, int maxDutyCycle);
+	bool setCurve(const CurvePoint points[], uint8_t count, bool append);
+	bool isValidCurve(const CurvePoint points[], uint8_t count, bool append) const;
+	bool setHysteresis(int hysteresis);
+
+	int update(int16_t temperature, unsigned long readTime);
+	int fail();
+
+	int getTarget() const;
+	int getKp() const;
+	int getKi() const;
+	int getKd() const;
+	int getMinDutyCycle() const;
+	int getMaxDutyCycle() const;
+	uint8_t getCurvePointCount() const;
+	const CurvePoint& getCurvePoint(uint8_t index) const;
+	int getHysteresis() const;
+	bool hasInput() const;
+	int16_t getInput() const;
+
+private:
+
+	DeviceAddress _sensors[MAX_CONTROL_SENSORS];
+	uint8_t _sensorCount;
+	bool _enabled;
+	ControlMode _mode;
+	int16_t _target; //Tenths of a degree
+	int16_t _kp;
+	int16_t _ki;
+	int16_t _kd;
+	uint8_t _minDutyCycle;
+	uint8_t _maxDutyCycle;
+	long _integral; //Integral term in output units
+	bool _hasInput;
+	int16_t _input; //Raw temperature of the last update
+	unsigned long _readTime; //Read time of _input
+	long _rate; //Change of temperature in 1/128 degrees per second
+	CurvePoint _curve[MAX_CURVE_POINTS];
+	uint8_t _curvePointCount;
+	uint8_t _hysteresis; //Tenths of a degree
+	int16_t _curveInput; //Temperature the curve is evaluated at, follows the input with hysteresis
+	uint8_t _output; //Dutycycle of the last curve evaluation
+
+	int updatePid(int16_t temperature, unsigned long readTime);
+	int updateCurve(int16_t temperature, unsigned long readTime);
+	int interpolate(int16_t temperature) const;
+};
+
+#endif
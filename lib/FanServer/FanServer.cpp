@@ -1,20 +1,112 @@
-#define ARDUINOJSON_ENABLE_PROGMEM 1
-#include <ArduinoJson.h>
 #include "FanServer.hpp"
 #include "HTTP.hpp"
 
-#define JSON_BUFFER_SIZE 350
 #define PIN_PARAMETER F("pin")
 #define FREQUENCY_PARAMETER F("frequency")
 #define DUTYCYCLE_PARAMETER F("dutycycle")
 #define CONFIG_PARAMETER F("config")
-#define LIMITS_ATTRIBUTE F("limits")
-#define DEFAULTS_ATTRIBUTE F("defaults")
-#define FANPINS_ATTRIBUTE F("fanpins")
+#define TACH_PARAMETER F("tach")
+#define PPR_PARAMETER F("ppr")
+#define RPM_ATTRIBUTE F("rpm")
+#define TARGET_RPM_PARAMETER F("targetrpm")
+#define RPM_ERROR_ATTRIBUTE F("rpmerror")
+#define SETTLING_TIME_ATTRIBUTE F("settlingtime")
+#define STALLED_ATTRIBUTE F("stalled")
+#define STALLS_ATTRIBUTE F("stalls")
+#define KICKS_ATTRIBUTE F("kicks")
+#define LAST_STALL_ATTRIBUTE F("laststall")
+#define SLEW_PARAMETER F("slew")
+#define CURRENT_DUTYCYCLE_ATTRIBUTE F("currentdutycycle")
+#define CONTROL_PATH F("control")
+#define CURVE_PATH F("curve")
+#define ENABLED_PARAMETER F("enabled")
+#define BIND_PARAMETER F("bind")
+#define UNBIND_PARAMETER F("unbind")
+#define TARGET_PARAMETER F("target")
+#define KP_PARAMETER F("kp")
+#define KI_PARAMETER F("ki")
+#define KD_PARAMETER F("kd")
+#define MIN_PARAMETER F("min")
+#define MAX_PARAMETER F("max")
+#define POINTS_PARAMETER F("points")
+#define ADD_PARAMETER F("add")
+#define HYSTERESIS_PARAMETER F("hysteresis")
+#define TEMPERATURE_ATTRIBUTE F("temperature")
+
+static const uint8_t ALLOWED_FAN_PINS[] PROGMEM = {3, 9, 10};
+static const uint8_t ALLOWED_TACH_PINS[] PROGMEM = {2, 5, 6, 7, 8, 14, 15, 16, 17, 18, 19};
 
+/**
+	Prints a member of a JSON-object, preceded by a comma unless it is the first one.
+
+	@param out: Print where the member is written
+	@param name: Name of the member
+	@param value: Integer value of the member
+	@param first: True for the first member of the object
+*/
+template <typename T>
+static void printMember(Print& out, const __FlashStringHelper* name, T value, bool first = false)
+{
+	if (!first) out.print(',');
+	out.print('"');
+	out.print(name);
+	out.print(F("\":"));
+	out.print(value);
+}
+
+/**
+	Reads an optional numeric parameter of a request.
+
+	@param request: First line of a HTTP-request
+	@param name: Name of the parameter
+	@param outValue: Value of the parameter, "Output variable". Unchanged unless the parameter is valid.
+	@param valid: Set to false if the parameter is sent but is not a number, "Output variable"
+	@return True if the parameter was sent and is a number
+*/
+template <typename T>
+static bool getOptionalParameter(const HttpRequest& request, const __FlashStringHelper* name, T& outValue, bool& valid)
+{
+	ParameterResult result = request.getParameter(name, outValue);
+	if (result == ParameterResult::INVALID) valid = false;
+	return result == ParameterResult::VALID;
+}
+
+/**
+	Prints a pin list from program memory as a JSON-array.
+
+	@param out: Print where the array is written
+	@param pins: Pins in program memory
+	@param count: Number of pins
+*/
+static void printPins(Print& out, const uint8_t pins[], uint8_t count)
+{
+	out.print('[');
+	for (uint8_t i=0; i<count; i++) {
+		if (i > 0) out.print(',');
+		out.print(pgm_read_byte(&pins[i]));
+	}
+	out.print(']');
+}
+
+/**
+	Checks if a pin is in a pin list in program memory.
+
+	@param pins: Pins in program memory
+	@param count: Number of pins
+	@param pin: Pin number to be checked
+	@return True if the pin is in the list
+*/
+static bool containsPin(const uint8_t pins[], uint8_t count, int pin)
+{
+	for (uint8_t i=0; i<count; i++) {
+		if (pgm_read_byte(&pins[i]) == pin) return true;
+	}
+	return false;
+}
 
-FanServer::FanServer()
-: _fans(), _fanCount(0)
+
+FanServer::FanServer(TemperatureServer& temperatures)
+: _fans(), _fanCount(0), _temperatures(temperatures), _lastControl(0)
 {
 	InitTimersSafe();
 }
@@ -26,95 +118,130 @@ FanServer::~FanServer()
 	}
 }
 
+/**
+	Takes snapshots of the tachometer pulse counts, kicks stalled fans and adjusts
+	the speed controlled fans after each snapshot. Updates dutycycles of the temperature controlled fans
+	every CONTROL_INTERVAL ms from the cached temperatures.
+	Intended to call run-method from the main-loop.
+*/
+void FanServer::run()
+{
+	for (int i=0; i<_fanCount; i++) {
+		Fan& fan = _fans[i];
+		bool sampled = fan.getTachometer().sample();
+		fan.checkStall();
+		//Speed during a kick does not tell how the dutycycle should change
+		if (sampled && !fan.isKicking() && fan.getSpeedController().isEnabled()) {
+			fan.setDutyCycle(fan.getSpeedController().update(fan.getTachometer().getRpm()));
+		}
+	}
+
+	if (millis() - _lastControl < CONTROL_INTERVAL) return;
+	_lastControl = millis();
+
+	for (int i=0; i<_fanCount; i++) {
+		if (_fans[i].getController().isEnabled()) controlFan(_fans[i]);
+	}
+}
+
 /**
 	Handles HTTP-request. If does not recognize request path and/or method, sends 404 Not found.
 
 	@param request: First line of a HTTP-request
-	@param client: Client to which the response is sent
+	@param response: Response to the client
 */
-void FanServer::handleRequest(const String& request, EthernetClient& client)
+void FanServer::handleRequest(const HttpRequest& request, HttpResponse& response)
 {
-	String path = HTTP::parseRequestPath(request, 2);
-	HTTPMethod method = HTTP::getRequestMethod(request);
+	const char* path = request.getPathSegment(2);
+	HTTPMethod method = request.getMethod();
 
 	if (method == HTTPMethod::PUT) {
-		return setFanProperties(client, request);
-	} else if (method == HTTPMethod::POST && path.length() == 0) {
-		return addFan(client, request);
-	} else if (method == HTTPMethod::DELETE && path.length() == 0) {
-		return removeFan(client, request);
+		if (request.isPath(2, CONTROL_PATH)) return setControl(response, request);
+		if (request.isPath(2, CURVE_PATH)) return setCurve(response, request);
+		return setFanProperties(response, request);
+	} else if (method == HTTPMethod::POST && strlen(path) == 0) {
+		return addFan(response, request);
+	} else if (method == HTTPMethod::DELETE && strlen(path) == 0) {
+		return removeFan(response, request);
 	} else if (method == HTTPMethod::GET) {
-		if (path.length() == 0) return sendFansJson(client, request);
-		if (path.equals(CONFIG_PARAMETER)) return sendConfigJson(client);
+		if (strlen(path) == 0) return sendFansJson(response, request);
+		if (request.isPath(2, CONFIG_PARAMETER)) return sendConfigJson(response);
+		if (request.isPath(2, CONTROL_PATH)) return sendControlJson(response, request);
+		if (request.isPath(2, CURVE_PATH)) return sendCurveJson(response, request);
 	}
-	HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_404_NOT_FOUND);
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_404_NOT_FOUND);
 }
 
 /**
 	Adds new fan to _fans and sends 201 Created response to the client with JSON
-	body. If fan cannot be added, sends 400 Bad request response to the client.
-	Pin-parameter is mandatory, frequency and dutycycle are optional.
-	Default values are defined in Fan.hpp.
+	body. Pin-parameter is mandatory, other settings are optional and checked like
+	in setFanProperties. If a setting is invalid or the fan cannot be added, no fan
+	is added and 400 Bad request is sent to the client. Default values are defined in Fan.hpp.
 
-	@param client: Client to which the response is sent
+	@param response: Response to the client
 	@param request: First line of a HTTP-request
 */
-void FanServer::addFan(EthernetClient& client, const String& request)
+void FanServer::addFan(HttpResponse& response, const HttpRequest& request)
 {
-	int pin = HTTP::parseRequestParameterIntValue(request, PIN_PARAMETER);
-	int frequency = HTTP::parseRequestParameterIntValue(request, FREQUENCY_PARAMETER);
-	int dutyCycle = HTTP::parseRequestParameterIntValue(request, DUTYCYCLE_PARAMETER);
-
-	// If fan doesn't exists and adding new fan fails, send error message and return
-	if (!findFan(pin) && !addFan(pin)) {
-		HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_400_BAD_REQUEST);
-		return;
+	int pin;
+	if (request.getParameter(PIN_PARAMETER, pin) != ParameterResult::VALID) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
 	}
 
-	setFrequency(pin, frequency);
-	setDutyCycle(pin, dutyCycle);
+	//An existing fan is reconfigured, a new one is only added if all of its settings are valid
+	Fan* fan = findFan(pin);
+	if ((!fan && (_fanCount >= MAX_FAN_COUNT || !isfreePin(pin))) || !isValidSettings(fan, request)) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	}
+	if (!fan && !addFan(pin)) return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
 
-	sendSingleFan(client, pin, HTTPResponseType::HTTP_201_CREATED);
+	if (!setSettings(pin, request)) {
+		if (!fan) removeFan(pin);
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	}
+	sendSingleFan(response, pin, HTTPResponseType::HTTP_201_CREATED);
 }
 
 /**
 	Removes fan from _fans and sends 204 No content response to the client.
 	If specified fan is not found or cannot be removed, sends 400 Bad request response to the client.
 
-	@param client: Client to which the response is sent
+	@param response: Response to the client
 	@param request: First line of a HTTP-request
 */
-void FanServer::removeFan(EthernetClient& client, const String& request)
+void FanServer::removeFan(HttpResponse& response, const HttpRequest& request)
 {
-	int pin = HTTP::parseRequestParameterIntValue(request, PIN_PARAMETER);
-	if (removeFan(pin)) {
-		return HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_204_NO_CONTENT);
+	int pin;
+	if (request.getParameter(PIN_PARAMETER, pin) == ParameterResult::VALID && removeFan(pin)) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_204_NO_CONTENT);
 	}
-	HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
 }
 
 /**
 	Sends fan-information of all fans in JSON format to the client.
 
-	@param client: Client to which the response is sent
+	@param response: Response to the client
 	@param request: First line of a HTTP-request
 */
-void FanServer::sendFansJson(EthernetClient &client, const String& request)
+void FanServer::sendFansJson(HttpResponse& response, const HttpRequest& request)
 {
-	int pin = HTTP::parseRequestParameterIntValue(request, PIN_PARAMETER);
+	int pin;
+	ParameterResult pinResult = request.getParameter(PIN_PARAMETER, pin);
 
-	if (pin > 0) {
-		sendSingleFan(client, pin, HTTPResponseType::HTTP_200_OK);
+	if (pinResult == ParameterResult::INVALID) {
+		HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	} else if (pinResult == ParameterResult::VALID) {
+		sendSingleFan(response, pin, HTTPResponseType::HTTP_200_OK);
 	} else {
-		StaticJsonBuffer<JSON_BUFFER_SIZE> jsonBuffer;
-		JsonArray& root = jsonBuffer.createArray();
+		HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
 
+		response.print('[');
 		for (int i=0; i<_fanCount; i++) {
-			addFanInfoToJsonObj(_fans[i], root.createNestedObject());
+			if (i > 0) response.print(',');
+			printFan(response, _fans[i]);
 		}
-
-		HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_200_OK);
-		root.printTo(client);
+		response.print(']');
 	}
 }
 
@@ -122,23 +249,18 @@ void FanServer::sendFansJson(EthernetClient &client, const String& request)
 	Sends fan-information in JSON format to the client.
 	If fan is not found, sends HTTP 400 Bad Request.
 
-	@param client: Client to which the response is sent
+	@param response: Response to the client
 	@param responseType: Response-code sent to client if fan is found
 	@param pin: Pin number of the fan
 */
-void FanServer::sendSingleFan(EthernetClient& client, int pin, HTTPResponseType responseType)
+void FanServer::sendSingleFan(HttpResponse& response, int pin, HTTPResponseType responseType)
 {
-	StaticJsonBuffer<JSON_BUFFER_SIZE> jsonBuffer;
-
 	Fan* fan = findFan(pin);
 	if (fan) {
-		JsonObject& fanObj = jsonBuffer.createObject();
-		addFanInfoToJsonObj(*fan, fanObj);
-
-		HTTP::sendHttpResponse(client, responseType);
-		fanObj.printTo(client);
+		HTTP::sendHttpResponse(response, responseType);
+		printFan(response, *fan);
 	} else {
-		HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_400_BAD_REQUEST);
+		HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
 	}
 }
 
@@ -146,56 +268,448 @@ void FanServer::sendSingleFan(EthernetClient& client, int pin, HTTPResponseType
 	Sends all config information: defaults, limits, minimum and maximum value
 	for fans in JSON format to the client.
 
-	@param client: Client to which the response is sent
+	@param response: Response to the client
+*/
+void FanServer::sendConfigJson(HttpResponse& response)
+{
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
+
+	response.print(F("{\"defaults\":{"));
+	printMember(response, DUTYCYCLE_PARAMETER, DEFAULT_DUTYCYCLE, true);
+	printMember(response, FREQUENCY_PARAMETER, DEFAULT_FREQUENCY);
+	printMember(response, PPR_PARAMETER, DEFAULT_PULSES_PER_REVOLUTION);
+	printMember(response, SLEW_PARAMETER, DEFAULT_SLEW_RATE);
+
+	response.print(F("},\"limits\":{"));
+	printMember(response, F("min dutycycle"), MIN_DUTYCYCLE, true);
+	printMember(response, F("min frequency"), MIN_FREQUENCY);
+	printMember(response, F("max frequency"), MAX_FREQUENCY);
+	printMember(response, F("max slew"), MAX_SLEW_RATE);
+
+	response.print(F("},\"fanpins\":"));
+	printPins(response, ALLOWED_FAN_PINS, sizeof(ALLOWED_FAN_PINS));
+	response.print(F(",\"tachpins\":"));
+	printPins(response, ALLOWED_TACH_PINS, sizeof(ALLOWED_TACH_PINS));
+	response.print('}');
+}
+
+/**
+	Changes settings of a fan and sends the fan to the client. Pin number must be
+	specified in the request, other settings are optional. If a setting is invalid,
+	nothing is changed and 400 Bad request is sent to the client.
+
+	@param response: Response to the client
+	@param request: First line of a HTTP-request
+*/
+void FanServer::setFanProperties(HttpResponse& response, const HttpRequest& request)
+{
+	int pin;
+	Fan* fan = request.getParameter(PIN_PARAMETER, pin) == ParameterResult::VALID ? findFan(pin) : nullptr;
+	if (!fan || !isValidSettings(fan, request) || !setSettings(pin, request)) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	}
+	sendSingleFan(response, pin, HTTPResponseType::HTTP_200_OK);
+}
+
+/**
+	Checks the optional settings of a request before any of them is changed.
+	A setting that is sent but is not a number is invalid.
+
+	@param fan: Fan to be changed, nullptr for a fan that is not added yet
+	@param request: First line of a HTTP-request
+	@return True if all settings sent in the request are valid for the fan
+*/
+bool FanServer::isValidSettings(Fan* fan, const HttpRequest& request)
+{
+	int dutyCycle, frequency, slewRate, tachPin;
+	long targetRpm;
+	bool active = fan && fan->getTachometer().isActive();
+	int currentTachPin = active ? fan->getTachometer().getPin() : 0;
+	int pulsesPerRevolution = fan ? fan->getTachometer().getPulsesPerRevolution() : DEFAULT_PULSES_PER_REVOLUTION;
+
+	bool valid = true;
+	bool hasSlewRate = getOptionalParameter(request, SLEW_PARAMETER, slewRate, valid);
+	bool hasDutyCycle = getOptionalParameter(request, DUTYCYCLE_PARAMETER, dutyCycle, valid);
+	bool hasFrequency = getOptionalParameter(request, FREQUENCY_PARAMETER, frequency, valid);
+	bool hasTachPin = getOptionalParameter(request, TACH_PARAMETER, tachPin, valid);
+	bool hasTargetRpm = getOptionalParameter(request, TARGET_RPM_PARAMETER, targetRpm, valid);
+	bool newTachPin = hasTachPin && tachPin != 0 && !(active && currentTachPin == tachPin);
+	bool hasTachometer = hasTachPin ? tachPin != 0 : active;
+	getOptionalParameter(request, PPR_PARAMETER, pulsesPerRevolution, valid);
+
+	return valid
+		&& !(hasSlewRate && (slewRate < 0 || slewRate > MAX_SLEW_RATE))
+		&& !(hasDutyCycle && (dutyCycle < 0 || dutyCycle > 100))
+		&& !(hasFrequency && (frequency < MIN_FREQUENCY || frequency > MAX_FREQUENCY))
+		&& pulsesPerRevolution >= 1 && pulsesPerRevolution <= MAX_PULSES_PER_REVOLUTION
+		&& !(newTachPin && !isFreeTachPin(tachPin))
+		&& !(hasTargetRpm && (targetRpm < 0 || targetRpm > MAX_TARGET_RPM || !hasTachometer));
+}
+
+/**
+	Changes the optional settings of a request, checked with isValidSettings first.
+
+	@param pin: Pin number of a fan
+	@param request: First line of a HTTP-request
+	@return False if the fan refused a setting, settings before it are kept
 */
-void FanServer::sendConfigJson(EthernetClient &client)
+bool FanServer::setSettings(int pin, const HttpRequest& request)
 {
-	StaticJsonBuffer<JSON_BUFFER_SIZE> jsonBuffer;
-	JsonObject& root = jsonBuffer.createObject();
+	int dutyCycle, frequency, slewRate;
+	long targetRpm;
+	Fan* fan = findFan(pin);
+	if (!fan) return false;
+
+	//Frequency is changed first, as the timer of the pin may still refuse it
+	if (request.getParameter(FREQUENCY_PARAMETER, frequency) == ParameterResult::VALID && !setFrequency(pin, frequency)) return false;
+	if (request.getParameter(SLEW_PARAMETER, slewRate) == ParameterResult::VALID && !fan->setSlewRate(slewRate)) return false;
+	if (request.getParameter(DUTYCYCLE_PARAMETER, dutyCycle) == ParameterResult::VALID && !setDutyCycle(pin, dutyCycle)) return false;
+	if (!setTachometer(pin, request)) return false;
+	return request.getParameter(TARGET_RPM_PARAMETER, targetRpm) != ParameterResult::VALID || setTargetRpm(pin, targetRpm);
+}
 
-	JsonObject& limits = root.createNestedObject(LIMITS_ATTRIBUTE);
-	JsonObject& defaults = root.createNestedObject(DEFAULTS_ATTRIBUTE);
-	JsonArray& fanPins = root.createNestedArray(FANPINS_ATTRIBUTE);
+/**
+	Sends temperature control settings and state of a fan in JSON format to the client.
+	If fan is not found, sends 400 Bad request response to the client.
 
-	defaults[F("dutycycle")] = DEFAULT_DUTYCYCLE;
-	defaults[F("frequency")] = DEFAULT_FREQUENCY;
+	@param response: Response to the client
+	@param request: First line of a HTTP-request
+*/
+void FanServer::sendControlJson(HttpResponse& response, const HttpRequest& request)
+{
+	int pin;
+	Fan* fan = request.getParameter(PIN_PARAMETER, pin) == ParameterResult::VALID ? findFan(pin) : nullptr;
+	if (!fan) return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+
+	FanController& controller = fan->getController();
+
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
+	printControlInfo(response, *fan, ControlMode::PID);
+	printMember(response, TARGET_PARAMETER, controller.getTarget());
+	printMember(response, KP_PARAMETER, controller.getKp());
+	printMember(response, KI_PARAMETER, controller.getKi());
+	printMember(response, KD_PARAMETER, controller.getKd());
+	printMember(response, MIN_PARAMETER, controller.getMinDutyCycle());
+	printMember(response, MAX_PARAMETER, controller.getMaxDutyCycle());
+	response.print('}');
+}
 
-	limits[F("min dutycycle")] = MIN_DUTYCYCLE;
-	limits[F("min frequency")] = MIN_FREQUENCY;
-	limits[F("max frequency")] = MAX_FREQUENCY;
+/**
+	Changes temperature control settings of a fan and sends the settings to the client.
+	Only the given settings are changed. If fan or sensor is not found or a setting
+	is invalid, nothing is changed and 400 Bad request response is sent to the client.
 
-	for (int pin : _allowedFanPins) {
-		fanPins.add(pin);
+	@param response: Response to the client
+	@param request: First line of a HTTP-request
+*/
+void FanServer::setControl(HttpResponse& response, const HttpRequest& request)
+{
+	int pin;
+	Fan* fan = request.getParameter(PIN_PARAMETER, pin) == ParameterResult::VALID ? findFan(pin) : nullptr;
+	if (!fan) return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+
+	FanController& controller = fan->getController();
+	int target = controller.getTarget();
+	int kp = controller.getKp(), ki = controller.getKi(), kd = controller.getKd();
+	int minDutyCycle = controller.getMinDutyCycle(), maxDutyCycle = controller.getMaxDutyCycle();
+
+	//Every setting is checked before any is changed, so an invalid request leaves the fan as it was.
+	//Missing settings keep their current values.
+	if (request.getParameter(TARGET_PARAMETER, target) == ParameterResult::INVALID
+		|| request.getParameter(KP_PARAMETER, kp) == ParameterResult::INVALID
+		|| request.getParameter(KI_PARAMETER, ki) == ParameterResult::INVALID
+		|| request.getParameter(KD_PARAMETER, kd) == ParameterResult::INVALID
+		|| request.getParameter(MIN_PARAMETER, minDutyCycle) == ParameterResult::INVALID
+		|| request.getParameter(MAX_PARAMETER, maxDutyCycle) == ParameterResult::INVALID
+		|| !isValidControl(controller, request)
+		|| target < MIN_CONTROL_TARGET || target > MAX_CONTROL_TARGET
+		|| kp < 0 || kp > MAX_CONTROL_GAIN || ki < 0 || ki > MAX_CONTROL_GAIN || kd < 0 || kd > MAX_CONTROL_GAIN
+		|| minDutyCycle < 0 || maxDutyCycle > 100 || minDutyCycle > maxDutyCycle) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
 	}
+	setBindings(controller, request);
+	controller.setTarget(target);
+	controller.setGains(kp, ki, kd);
+	controller.setLimits(minDutyCycle, maxDutyCycle);
+	setEnabled(*fan, ControlMode::PID, request);
+	sendControlJson(response, request);
+}
+
+/**
+	Sends fan curve and its state of a fan in JSON format to the client.
+	If fan is not found, sends 400 Bad request response to the client.
 
-	HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_200_OK);
-	root.printTo(client);
+	@param response: Response to the client
+	@param request: First line of a HTTP-request
+*/
+void FanServer::sendCurveJson(HttpResponse& response, const HttpRequest& request)
+{
+	int pin;
+	Fan* fan = request.getParameter(PIN_PARAMETER, pin) == ParameterResult::VALID ? findFan(pin) : nullptr;
+	if (!fan) return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+
+	FanController& controller = fan->getController();
+
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
+	printControlInfo(response, *fan, ControlMode::CURVE);
+	response.print(F(",\"points\":"));
+	printCurve(response, controller);
+	printMember(response, HYSTERESIS_PARAMETER, controller.getHysteresis());
+	printMember(response, MIN_PARAMETER, controller.getMinDutyCycle());
+	printMember(response, MAX_PARAMETER, controller.getMaxDutyCycle());
+	response.print('}');
 }
 
 /**
-	Sets dutycycle to a fan and sends 204 No content response to the client.
-	Pin number and new dutycycle must be specified in the request.
-	If dutycycle cannot be applied, 400 Bad request is sent to the client.
+	Changes fan curve of a fan and sends the curve to the client. Points replace
+	the curve and added points continue it, so a curve longer than a request line
+	can be sent with several requests. If fan or sensor is not found or a setting
+	is invalid, nothing is changed and 400 Bad request response is sent to the client.
 
-	@param client: Client to which the response is sent
+	@param response: Response to the client
 	@param request: First line of a HTTP-request
 */
-void FanServer::setFanProperties(EthernetClient& client, const String& request)
+void FanServer::setCurve(HttpResponse& response, const HttpRequest& request)
+{
+	int pin;
+	Fan* fan = request.getParameter(PIN_PARAMETER, pin) == ParameterResult::VALID ? findFan(pin) : nullptr;
+	if (!fan) return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+
+	FanController& controller = fan->getController();
+	CurvePoint points[MAX_CURVE_POINTS];
+	int count = 0;
+	int hysteresis = controller.getHysteresis();
+	ParameterResult hysteresisResult = request.getParameter(HYSTERESIS_PARAMETER, hysteresis);
+
+	const char* text = request.getParameter(POINTS_PARAMETER);
+	bool append = false;
+	if (!text) {
+		text = request.getParameter(ADD_PARAMETER);
+		append = true;
+	}
+	if (text) count = parseCurve(text, points);
+
+	//Every setting is checked before any is changed, so an invalid request leaves the fan as it was
+	if (hysteresisResult == ParameterResult::INVALID
+		|| !isValidControl(controller, request)
+		|| count < 0 || (text && !controller.isValidCurve(points, count, append))
+		|| hysteresis < 0 || hysteresis > MAX_HYSTERESIS) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	}
+	setBindings(controller, request);
+	if (text) controller.setCurve(points, count, append);
+	controller.setHysteresis(hysteresis);
+	setEnabled(*fan, ControlMode::CURVE, request);
+	sendCurveJson(response, request);
+}
+
+/**
+	Sets dutycycle of a fan from the hottest of its bound sensors. If none of the
+	sensors has a reading, the fan runs at the maximum dutycycle of the controller.
+
+	@param fan: Temperature controlled fan
+*/
+void FanServer::controlFan(Fan& fan)
 {
-	int pin = HTTP::parseRequestParameterIntValue(request, PIN_PARAMETER);
+	FanController& controller = fan.getController();
+	int16_t temperature = DEVICE_DISCONNECTED_RAW, raw;
+	unsigned long readTime = 0, sensorReadTime;
+
+	for (uint8_t i=0; i<controller.getSensorCount(); i++) {
+		if (_temperatures.getCachedTemperature(controller.getSensor(i), raw, sensorReadTime) && raw > temperature) {
+			temperature = raw;
+			readTime = sensorReadTime;
+		}
+	}
 
-	if (findIndex(pin) < 0) {
-		HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_400_BAD_REQUEST);
-		return;
+	if (temperature > DEVICE_DISCONNECTED_RAW) {
+		fan.setDutyCycle(controller.update(temperature, readTime));
+	} else {
+		fan.setDutyCycle(controller.fail());
 	}
+}
 
-	int dutyCycle = HTTP::parseRequestParameterIntValue(request, DUTYCYCLE_PARAMETER);
-	int frequency = HTTP::parseRequestParameterIntValue(request, FREQUENCY_PARAMETER);
+/**
+	Binds and unbinds sensors given in the request. The request must be checked
+	with isValidControl first.
 
-	setDutyCycle(pin, dutyCycle);
-	setFrequency(pin, frequency);
+	@param controller: Controller of the fan
+	@param request: First line of a HTTP-request
+*/
+void FanServer::setBindings(FanController& controller, const HttpRequest& request)
+{
+	DeviceAddress address;
 
-	sendSingleFan(client, pin, HTTPResponseType::HTTP_200_OK);
+	const char* id = request.getParameter(UNBIND_PARAMETER);
+	if (id) controller.unbind(findBinding(controller, id));
+	id = request.getParameter(BIND_PARAMETER);
+	if (id && _temperatures.getSensorAddress(id, address)) controller.bind(address);
+}
+
+/**
+	Checks sensor bindings and starting of control given in the request without
+	changing the controller. A sensor can be unbound and bound in the same request.
+
+	@param controller: Controller of the fan
+	@param request: First line of a HTTP-request
+	@return false if a sensor is not found, the controller has no room for it,
+	enabled is not a number or control is started without a bound sensor
+*/
+bool FanServer::isValidControl(const FanController& controller, const HttpRequest& request)
+{
+	DeviceAddress address;
+	int enabled;
+	int unbound = -1;
+	uint8_t sensorCount = controller.getSensorCount();
+
+	const char* id = request.getParameter(UNBIND_PARAMETER);
+	if (id) {
+		unbound = findBinding(controller, id);
+		if (unbound < 0) return false;
+		sensorCount--;
+	}
+	id = request.getParameter(BIND_PARAMETER);
+	if (id) {
+		if (!_temperatures.getSensorAddress(id, address)) return false;
+		int bound = -1;
+		for (uint8_t i=0; i<controller.getSensorCount(); i++) {
+			if (memcmp(controller.getSensor(i), address, sizeof(DeviceAddress)) == 0) bound = i;
+		}
+		if (bound < 0 || bound == unbound) sensorCount++;
+		if (sensorCount > MAX_CONTROL_SENSORS) return false;
+	}
+	ParameterResult enabledResult = request.getParameter(ENABLED_PARAMETER, enabled);
+	if (enabledResult == ParameterResult::INVALID) return false;
+	return !(enabledResult == ParameterResult::VALID && enabled && sensorCount == 0);
+}
+
+/**
+	Finds a sensor binding of a controller. The sensor does not need to be known
+	anymore, so bindings of removed sensors can be removed too.
+
+	@param controller: Controller of the fan
+	@param id: ID of the sensor, case insensitive
+	@return Index of the binding, -1 if the sensor is not bound
+*/
+int FanServer::findBinding(const FanController& controller, const char* id)
+{
+	char boundId[SENSOR_ID_LENGTH + 1];
+	for (uint8_t i=0; i<controller.getSensorCount(); i++) {
+		_temperatures.getSensorId(controller.getSensor(i), boundId);
+		if (strcasecmp(boundId, id) == 0) return i;
+	}
+	return -1;
+}
+
+/**
+	Starts or stops temperature control as given in the request. Starting needs a bound
+	sensor. A started controller takes over from the speed controller and sets the
+	dutycycle at once.
+
+	@param fan: Fan to control
+	@param mode: Mode started
+	@param request: First line of a HTTP-request
+*/
+void FanServer::setEnabled(Fan& fan, ControlMode mode, const HttpRequest& request)
+{
+	int enabled;
+
+	if (request.getParameter(ENABLED_PARAMETER, enabled) != ParameterResult::VALID) return;
+	if (!enabled) return fan.getController().disable();
+	if (fan.getController().getSensorCount() == 0) return;
+
+	fan.getSpeedController().disable();
+	fan.getController().enable(mode, fan.getDutycycle());
+	controlFan(fan);
+}
+
+/**
+	Prints the start of a JSON-object with settings and state shared by the control
+	modes. The caller adds the settings of the mode and closes the object.
+
+	@param out: Print where the object is written
+	@param fan: Fan to extract the information from
+	@param mode: Mode the information is sent for, enabled only if the fan is controlled with it
+*/
+void FanServer::printControlInfo(Print& out, Fan& fan, ControlMode mode)
+{
+	FanController& controller = fan.getController();
+	bool enabled = controller.isEnabled() && controller.getMode() == mode;
+	char id[SENSOR_ID_LENGTH + 1];
+
+	out.print('{');
+	printMember(out, PIN_PARAMETER, fan.getPin(), true);
+	printMember(out, ENABLED_PARAMETER, enabled ? 1 : 0);
+	out.print(F(",\"sensors\":["));
+	for (uint8_t i=0; i<controller.getSensorCount(); i++) {
+		_temperatures.getSensorId(controller.getSensor(i), id);
+		if (i > 0) out.print(',');
+		out.print('"');
+		out.print(id);
+		out.print('"');
+	}
+	out.print(']');
+	//Temperature the controller last used in tenths of a degree
+	if (enabled && controller.hasInput()) {
+		printMember(out, TEMPERATURE_ATTRIBUTE, (long)controller.getInput() * 10 / 128);
+	}
+	printMember(out, DUTYCYCLE_PARAMETER, fan.getDutycycle());
+}
+
+/**
+	Parses fan curve points.
+
+	@param text: Points as "temperature:dutycycle" pairs separated with commas, temperatures in tenths of a degree
+	@param outPoints: Parsed points, "Output variable"
+	@return Number of points, -1 if the text is invalid or has too many points
+
+	Example:
+	text = "300:20,450:100"
+	returns 2, outPoints = {{300, 20}, {450, 100}}
+*/
+int FanServer::parseCurve(const char* text, CurvePoint outPoints[])
+{
+	int count = 0;
+	char* end;
+
+	while (*text) {
+		if (count >= MAX_CURVE_POINTS) return -1;
+
+		long temperature = strtol(text, &end, 10);
+		if (end == text || *end != ':') return -1;
+		text = end + 1;
+		long dutyCycle = strtol(text, &end, 10);
+		if (end == text || (*end != ',' && *end != '\0')) return -1;
+		if (temperature < MIN_CURVE_TEMPERATURE || temperature > MAX_CURVE_TEMPERATURE) return -1;
+		if (dutyCycle < 0 || dutyCycle > 100) return -1;
+
+		outPoints[count].temperature = temperature;
+		outPoints[count].dutyCycle = dutyCycle;
+		count++;
+		text = *end ? end + 1 : end;
+	}
+	return count;
+}
+
+/**
+	Prints fan curve points as JSON array of [temperature, dutycycle] pairs.
+
+	@param out: Print where the array is written
+	@param controller: Controller of the fan
+*/
+void FanServer::printCurve(Print& out, const FanController& controller)
+{
+	out.print('[');
+	for (uint8_t i=0; i<controller.getCurvePointCount(); i++) {
+		const CurvePoint& point = controller.getCurvePoint(i);
+		if (i > 0) out.print(',');
+		out.print('[');
+		out.print(point.temperature);
+		out.print(',');
+		out.print(point.dutyCycle);
+		out.print(']');
+	}
+	out.print(']');
 }
 
 /**
@@ -237,28 +751,65 @@ Fan* FanServer::findFan(int pin)
 */
 bool FanServer::isfreePin(int pin)
 {
-	for (int allowedPin : _allowedFanPins) {
-		if (pin == allowedPin) {
-			for (int i=0; i<_fanCount; i++) {
-				if (_fans[i].getPin() == pin) return false;
-			}
-			return true;
-		}
+	if (!containsPin(ALLOWED_FAN_PINS, sizeof(ALLOWED_FAN_PINS), pin)) return false;
+
+	for (int i=0; i<_fanCount; i++) {
+		if (_fans[i].getPin() == pin) return false;
 	}
-	return false;
+	return true;
+}
+
+/**
+	Checks if tachometer pin is allowed and not used by another fan.
+
+	@param pin: Pin number to be checked
+	@return True if tachometer pin is free to use, otherwise False
+*/
+bool FanServer::isFreeTachPin(int pin)
+{
+	if (!containsPin(ALLOWED_TACH_PINS, sizeof(ALLOWED_TACH_PINS), pin)) return false;
+
+	for (int i=0; i<_fanCount; i++) {
+		Tachometer& tachometer = _fans[i].getTachometer();
+		if (tachometer.isActive() && tachometer.getPin() == pin) return false;
+	}
+	return true;
 }
 
 /**
-	Adds fan information to JsonObject.
+	Prints fan information as a JSON-object.
 
+	@param out: Print where the object is written
 	@param fan: desired fan to extract the information from
-	@param outFanJsonObject: Object where the fan information is stored
 */
-void FanServer::addFanInfoToJsonObj(Fan& fan, JsonObject &outFanJsonObject)
+void FanServer::printFan(Print& out, Fan& fan)
 {
-	outFanJsonObject[PIN_PARAMETER] = fan.getPin();
-	outFanJsonObject[FREQUENCY_PARAMETER] = fan.getFrequency();
-	outFanJsonObject[DUTYCYCLE_PARAMETER] = fan.getDutycycle();
+	out.print('{');
+	printMember(out, PIN_PARAMETER, fan.getPin(), true);
+	printMember(out, FREQUENCY_PARAMETER, fan.getFrequency());
+	printMember(out, DUTYCYCLE_PARAMETER, fan.getDutycycle());
+	printMember(out, CURRENT_DUTYCYCLE_ATTRIBUTE, fan.getCurrentDutycycle());
+	printMember(out, SLEW_PARAMETER, fan.getRamp().getSlewRate());
+
+	Tachometer& tachometer = fan.getTachometer();
+	if (tachometer.isActive()) {
+		printMember(out, TACH_PARAMETER, tachometer.getPin());
+		printMember(out, PPR_PARAMETER, tachometer.getPulsesPerRevolution());
+		printMember(out, RPM_ATTRIBUTE, tachometer.getRpm());
+		printMember(out, STALLED_ATTRIBUTE, fan.isStalled() ? 1 : 0);
+		printMember(out, STALLS_ATTRIBUTE, fan.getStallCount());
+		printMember(out, KICKS_ATTRIBUTE, fan.getKickCount());
+		//Age of the last stall in ms
+		if (fan.getStallCount() > 0) printMember(out, LAST_STALL_ATTRIBUTE, millis() - fan.getLastStall());
+	}
+
+	SpeedController& speedController = fan.getSpeedController();
+	if (speedController.isEnabled()) {
+		printMember(out, TARGET_RPM_PARAMETER, speedController.getTargetRpm());
+		printMember(out, RPM_ERROR_ATTRIBUTE, speedController.getError());
+		if (speedController.isSettled()) printMember(out, SETTLING_TIME_ATTRIBUTE, speedController.getSettlingTime());
+	}
+	out.print('}');
 }
 
 /**
@@ -291,6 +842,9 @@ bool FanServer::removeFan(int pin)
 	int index = findIndex(pin);
 
 	if (index >= 0) {
+		_fans[index].getTachometer().end();
+		//Removed fan is stopped at once
+		_fans[index].getRamp().end();
 		_fans[index].~Fan();
 		//Check if removing last fan of array
 		if (!(index == _fanCount-1)) {
@@ -323,7 +877,7 @@ bool FanServer::setFrequency(int pin, int frequency)
 }
 
 /**
-	Sets new dutycycle to fan specified.
+	Sets new dutycycle to fan specified. Temperature and speed control of the fan are disabled.
 
 	@param pin: Pin number of a fan
 	@param dutyCycle: new dutyCycle
@@ -334,7 +888,78 @@ bool FanServer::setDutyCycle(int pin, int dutyCycle)
 {
 	Fan* fan = findFan(pin);
 	if (fan) {
+		fan->getController().disable();
+		fan->getSpeedController().disable();
 		return fan->setDutyCycle(dutyCycle);
 	}
 	return false;
 }
+
+/**
+	Sets tachometer of a fan from tach and ppr parameters of the request.
+
+	@param pin: Pin number of a fan
+	@param request: First line of a HTTP-request
+	@return false if the tachometer or ppr is invalid or no fan found
+*/
+bool FanServer::setTachometer(int pin, const HttpRequest& request)
+{
+	Fan* fan = findFan(pin);
+	if (!fan) return false;
+
+	int tachPin, pulsesPerRevolution = fan->getTachometer().getPulsesPerRevolution();
+	request.getParameter(PPR_PARAMETER, pulsesPerRevolution);
+	if (request.getParameter(TACH_PARAMETER, tachPin) == ParameterResult::VALID) {
+		return setTachometer(pin, tachPin, pulsesPerRevolution);
+	}
+	return fan->getTachometer().setPulsesPerRevolution(pulsesPerRevolution);
+}
+
+/**
+	Sets new tachometer to fan specified.
+
+	@param pin: Pin number of a fan
+	@param tachPin: Pin of the tachometer output, 0 to remove the tachometer
+	@param pulsesPerRevolution: Pulses the fan gives per revolution
+	@return True if the tachometer was successfully changed.
+		If not succesful or no fan found, returns false.
+*/
+bool FanServer::setTachometer(int pin, int tachPin, int pulsesPerRevolution)
+{
+	Fan* fan = findFan(pin);
+	if (!fan) return false;
+
+	Tachometer& tachometer = fan->getTachometer();
+	if (tachPin == 0) {
+		tachometer.end();
+		fan->getSpeedController().disable();
+		return true;
+	}
+	if (tachometer.isActive() && tachometer.getPin() == tachPin) {
+		return tachometer.setPulsesPerRevolution(pulsesPerRevolution);
+	}
+	if (!isFreeTachPin(tachPin) || pulsesPerRevolution < 1 || pulsesPerRevolution > MAX_PULSES_PER_REVOLUTION) {
+		return false;
+	}
+	return tachometer.begin(tachPin, pulsesPerRevolution);
+}
+
+/**
+	Sets target RPM to fan specified. Speed control needs a tachometer and
+	replaces temperature control. Target 0 stops the fan.
+
+	@param pin: Pin number of a fan
+	@param targetRpm: Target speed, 0 to stop the fan
+	@return True if the target was successfully changed.
+		If not succesful or no fan found, returns false.
+*/
+bool FanServer::setTargetRpm(int pin, long targetRpm)
+{
+	Fan* fan = findFan(pin);
+	if (!fan || !fan->getTachometer().isActive()) return false;
+	if (targetRpm == 0) return setDutyCycle(pin, 0);
+
+	if (!fan->getSpeedController().enable(targetRpm, fan->getDutycycle())) return false;
+	fan->getController().disable();
+	return true;
+}
@@ -4,42 +4,62 @@
 #define FANSERVER_PATH "fans"
 #define MAX_FAN_COUNT 3
 
-#include <EthernetClient.h>
-#include <ArduinoJson.h>
 #include "ArduinoServerInterface.hpp"
 #include "Fan.hpp"
 #include "HTTP.hpp"
+#include "HttpRequest.hpp"
+#include "TemperatureServer.hpp"
 
 
 class FanServer : public ArduinoServerInterface
 {
 public:
-	FanServer();
+	FanServer(TemperatureServer& temperatures);
 	~FanServer();
 
-	void handleRequest(const String& request, EthernetClient& client);
+	void run();
+	void handleRequest(const HttpRequest& request, HttpResponse& response);
 
-	void addFan(EthernetClient& client, const String& request);
-	void removeFan(EthernetClient& client, const String& request);
-	void sendFansJson(EthernetClient& client, const String& request);
-	void sendSingleFan(EthernetClient& client, int pin, HTTPResponseType responseType);
-	void sendConfigJson(EthernetClient& client);
-	void setFanProperties(EthernetClient& client, const String& request);
+	void addFan(HttpResponse& response, const HttpRequest& request);
+	void removeFan(HttpResponse& response, const HttpRequest& request);
+	void sendFansJson(HttpResponse& response, const HttpRequest& request);
+	void sendSingleFan(HttpResponse& response, int pin, HTTPResponseType responseType);
+	void sendConfigJson(HttpResponse& response);
+	void setFanProperties(HttpResponse& response, const HttpRequest& request);
+	void sendControlJson(HttpResponse& response, const HttpRequest& request);
+	void setControl(HttpResponse& response, const HttpRequest& request);
+	void sendCurveJson(HttpResponse& response, const HttpRequest& request);
+	void setCurve(HttpResponse& response, const HttpRequest& request);
 
 private:
 	Fan _fans[MAX_FAN_COUNT];
-	int _allowedFanPins[3] = {3,9,10};
 	int _fanCount;
+	TemperatureServer& _temperatures;
+	unsigned long _lastControl;
 
 	int findIndex(int pin);
 	Fan* findFan(int pin);
 	bool isfreePin(int pin);
+	bool isFreeTachPin(int pin);
+	void controlFan(Fan& fan);
+	void setBindings(FanController& controller, const HttpRequest& request);
+	bool isValidControl(const FanController& controller, const HttpRequest& request);
+	int findBinding(const FanController& controller, const char* id);
+	void setEnabled(Fan& fan, ControlMode mode, const HttpRequest& request);
+	void printControlInfo(Print& out, Fan& fan, ControlMode mode);
+	int parseCurve(const char* text, CurvePoint outPoints[]);
+	void printCurve(Print& out, const FanController& controller);
 
-	void addFanInfoToJsonObj(Fan& fan, JsonObject& outObject);
+	void printFan(Print& out, Fan& fan);
 	bool addFan(int pin, int frequency = DEFAULT_FREQUENCY, int dutyCycle = DEFAULT_DUTYCYCLE);
 	bool removeFan(int pin);
 	bool setFrequency(int pin, int frequency);
 	bool setDutyCycle(int pin, int dutyCycle);
+	bool setTachometer(int pin, int tachPin, int pulsesPerRevolution);
+	bool setTachometer(int pin, const HttpRequest& request);
+	bool setTargetRpm(int pin, long targetRpm);
+	bool isValidSettings(Fan* fan, const HttpRequest& request);
+	bool setSettings(int pin, const HttpRequest& request);
 };
 
 #endif
@@ -0,0 +1,163 @@
+#include "PwmRamp.hpp"
+
+//Shared with the interrupt handler. A slot is free when its pin is 0, which is never a fan pin.
+static volatile uint8_t rampPins[MAX_RAMPS];
+static volatile uint16_t rampValues[MAX_RAMPS]; //PWM values in 1/256 steps
+static volatile uint8_t rampTargets[MAX_RAMPS];
+static volatile uint16_t rampSteps[MAX_RAMPS]; //Change per tick in 1/256 steps, 0 for no ramping
+static uint8_t tickCount;
+
+/**
+	Steps the ramps towards their targets every RAMP_TICK_INTERRUPTS interrupts.
+	The output is written only when the whole part of the value changes.
+*/
+ISR(TIMER0_COMPB_vect)
+{
+	if (++tickCount < RAMP_TICK_INTERRUPTS) return;
+	tickCount = 0;
+
+	for (uint8_t i=0; i<MAX_RAMPS; i++) {
+		uint16_t value = rampValues[i];
+		uint16_t target = rampTargets[i] << 8;
+		if (rampPins[i] == 0 || value == target) continue;
+
+		uint16_t step = rampSteps[i];
+		if (value < target) {
+			value = target - value > step ? value + step : target;
+		} else {
+			value = value - target > step ? value - step : target;
+		}
+		if ((value >> 8) != (rampValues[i] >> 8)) pwmWrite(rampPins[i], value >> 8);
+		rampValues[i] = value;
+	}
+}
+
+
+PwmRamp::PwmRamp()
+: _slot(-1), _pin(0), _slewRate(DEFAULT_SLEW_RATE)
+{
+}
+
+/**
+	Starts ramping the pin. The output keeps its value until the first write.
+
+	@param pin: PWM pin
+	@return false if all ramps are in use
+*/
+bool PwmRamp::begin(uint8_t pin)
+{
+	end();
+	for (uint8_t i=0; i<MAX_RAMPS && _slot < 0; i++) {
+		if (rampPins[i] == 0) _slot = i;
+	}
+	if (_slot < 0) return false;
+
+	_pin = pin;
+	uint8_t oldSREG = SREG;
+	cli();
+	rampValues[_slot] = 0;
+	rampTargets[_slot] = 0;
+	rampPins[_slot] = pin;
+	SREG = oldSREG;
+	setSlewRate(_slewRate);
+
+	//Compare B of Timer0 is free and matches once every millis() tick
+	TIMSK0 |= _BV(OCIE0B);
+	return true;
+}
+
+/**
+	Stops ramping. The output keeps its current value.
+*/
+void PwmRamp::end()
+{
+	if (_slot < 0) return;
+	rampPins[_slot] = 0;
+	_slot = -1;
+}
+
+bool PwmRamp::isActive() const
+{
+	return _slot >= 0;
+}
+
+/**
+	@param slewRate: Dutycycle percent per second, 0 to apply changes at once
+	@return false if out of range
+*/
+bool PwmRamp::setSlewRate(int slewRate)
+{
+	if (slewRate < 0 || slewRate > MAX_SLEW_RATE) return false;
+	_slewRate = slewRate;
+	if (_slot < 0) return true;
+
+	uint16_t step = ((unsigned long)slewRate * 255 * 256 + 50 * RAMP_TICKS_PER_SECOND) / (100 * RAMP_TICKS_PER_SECOND);
+	if (slewRate > 0 && step == 0) step = 1;
+	uint8_t oldSREG = SREG;
+	cli();
+	rampSteps[_slot] = step;
+	SREG = oldSREG;
+	return true;
+}
+
+int PwmRamp::getSlewRate() const
+{
+	return _slewRate;
+}
+
+/**
+	Sets new target of the output. Without a slew rate the output is changed at once.
+
+	@param value: PWM value from 0 to 255
+*/
+void PwmRamp::write(uint8_t value)
+{
+	if (_slot < 0) return;
+	if (_slewRate == 0) return jump(value);
+	//The interrupt writes the output from now on
+	rampTargets[_slot] = value;
+}
+
+/**
+	Changes the output at once without ramping.
+
+	@param value: PWM value from 0 to 255
+*/
+void PwmRamp::jump(uint8_t value)
+{
+	if (_slot < 0) return;
+
+	//Ramp is stopped before writing, so the interrupt does not write the pin at the same time
+	uint8_t oldSREG = SREG;
+	cli();
+	rampTargets[_slot] = value;
+	rampValues[_slot] = value << 8;
+	SREG = oldSREG;
+	pwmWrite(_pin, value);
+}
+
+/**
+	@return True if the output has not reached its target
+*/
+bool PwmRamp::isRamping() const
+{
+	if (_slot < 0) return false;
+	uint8_t oldSREG = SREG;
+	cli();
+	bool ramping = rampValues[_slot] != (uint16_t)(rampTargets[_slot] << 8);
+	SREG = oldSREG;
+	return ramping;
+}
+
+/**
+	@return Current PWM value of the output, from 0 to 255
+*/
+uint8_t PwmRamp::getValue() const
+{
+	if (_slot < 0) return 0;
+	uint8_t oldSREG = SREG;
+	cli();
+	uint8_t value = rampValues[_slot] >> 8;
+	SREG = oldSREG;
+	return value;
+}
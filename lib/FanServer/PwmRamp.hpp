@@ -0,0 +1,41 @@
+#ifndef PwmRamp_h
+#define PwmRamp_h
+
+#define MAX_RAMPS 3
+#define RAMP_TICK_INTERRUPTS 10 //Timer0 interrupts between ramp steps, about 10 ms
+#define RAMP_TICKS_PER_SECOND (F_CPU / 64 / 256 / RAMP_TICK_INTERRUPTS) //Timer0 runs with prescaler 64
+#define MAX_SLEW_RATE 1000 //Dutycycle percent per second
+#define DEFAULT_SLEW_RATE 0 //Changes are applied at once
+
+#include <Arduino.h>
+#include "PWM.h"
+
+/**
+	Ramps PWM output of a pin towards its target value with a limited slew rate.
+	Ramps are stepped by the Timer0 compare B interrupt, which runs alongside
+	millis() without changing Timer0, so ramping costs nothing in the main-loop.
+*/
+class PwmRamp
+{
+public:
+
+	PwmRamp();
+
+	bool begin(uint8_t pin);
+	void end();
+	bool isActive() const;
+	bool setSlewRate(int slewRate);
+	int getSlewRate() const;
+	void write(uint8_t value);
+	void jump(uint8_t value);
+	bool isRamping() const;
+	uint8_t getValue() const;
+
+private:
+
+	int8_t _slot; //Index of the ramp stepped by the interrupt, -1 when not in use
+	uint8_t _pin;
+	uint16_t _slewRate;
+};
+
+#endif
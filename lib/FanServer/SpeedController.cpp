@@ -0,0 +1,102 @@
+#include "SpeedController.hpp"
+
+#define OUTPUT_SCALE 100L //Hundredths of dutycycle percent per percent
+
+SpeedController::SpeedController()
+: _enabled(false), _targetRpm(0), _integral(0), _error(0), _inTolerance(0),
+_settled(false), _targetChanged(0), _inToleranceSince(0), _settlingTime(0)
+{
+}
+
+/**
+	Sets target RPM and enables the control. When the control takes over, the
+	integral starts from the current dutycycle, so the fan does not jump.
+
+	@param targetRpm: Target speed, from 1 to MAX_TARGET_RPM
+	@param dutyCycle: Current dutycycle of the fan
+	@return false if target is out of range
+*/
+bool SpeedController::enable(long targetRpm, int dutyCycle)
+{
+	if (targetRpm < 1 || targetRpm > MAX_TARGET_RPM) return false;
+
+	if (!_enabled) _integral = constrain(dutyCycle, MIN_SPEED_DUTYCYCLE, 100) * OUTPUT_SCALE;
+	_enabled = true;
+	_targetRpm = targetRpm;
+	_inTolerance = 0;
+	_settled = false;
+	_targetChanged = millis();
+	_settlingTime = 0;
+	return true;
+}
+
+void SpeedController::disable()
+{
+	_enabled = false;
+}
+
+bool SpeedController::isEnabled() const
+{
+	return _enabled;
+}
+
+/**
+	Computes new dutycycle from the measured speed and tracks when the speed
+	settles within the tolerance of the target. The integral is limited to the
+	dutycycle range to avoid windup.
+
+	@param rpm: Speed measured over the tachometer window
+	@return Dutycycle from MIN_SPEED_DUTYCYCLE to 100
+*/
+int SpeedController::update(unsigned int rpm)
+{
+	_error = constrain((long)rpm - _targetRpm, -MAX_TARGET_RPM, MAX_TARGET_RPM);
+
+	int tolerance = (long)_targetRpm * SPEED_TOLERANCE / 100;
+	if (tolerance < MIN_SPEED_TOLERANCE) tolerance = MIN_SPEED_TOLERANCE;
+	if (abs(_error) <= tolerance) {
+		if (_inTolerance == 0) _inToleranceSince = millis();
+		if (_inTolerance < SETTLE_SAMPLES) _inTolerance++;
+		if (_inTolerance >= SETTLE_SAMPLES && !_settled) {
+			_settled = true;
+			_settlingTime = _inToleranceSince - _targetChanged;
+		}
+	} else {
+		_inTolerance = 0;
+		_settled = false;
+	}
+
+	long correction = -(long)_error;
+	_integral = constrain(_integral + correction * SPEED_KI, MIN_SPEED_DUTYCYCLE * OUTPUT_SCALE, 100 * OUTPUT_SCALE);
+	long output = _integral + correction * SPEED_KP;
+	return constrain((output + OUTPUT_SCALE / 2) / OUTPUT_SCALE, MIN_SPEED_DUTYCYCLE, 100);
+}
+
+unsigned int SpeedController::getTargetRpm() const
+{
+	return _targetRpm;
+}
+
+/**
+	@return Measured RPM - target RPM of the last update
+*/
+int SpeedController::getError() const
+{
+	return _error;
+}
+
+/**
+	@return True if the speed has stayed within the tolerance of the target for SETTLE_SAMPLES updates
+*/
+bool SpeedController::isSettled() const
+{
+	return _settled;
+}
+
+/**
+	@return ms from setting the target until the speed settled, valid when settled
+*/
+unsigned long SpeedController::getSettlingTime() const
+{
+	return _settlingTime;
+}
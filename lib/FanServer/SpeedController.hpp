@@ -0,0 +1,49 @@
+#ifndef SpeedController_h
+#define SpeedController_h
+
+#define MAX_TARGET_RPM 20000
+#define MIN_SPEED_DUTYCYCLE 1 //Fans with a tachometer are kicked if they stall, so they need no higher floor
+#define SPEED_KP 2 //Hundredths of dutycycle percent per RPM of error
+#define SPEED_KI 1 //Hundredths of dutycycle percent per RPM of error and update
+#define SPEED_TOLERANCE 3 //Percent of the target RPM the speed is settled within
+#define MIN_SPEED_TOLERANCE 30 //RPM
+#define SETTLE_SAMPLES 4 //Updates within the tolerance before the speed is settled
+
+#include <Arduino.h>
+
+/**
+	PI controller keeping a fan at a target RPM. Updated with every new tachometer
+	snapshot, so the loop runs at the fixed rate of TACH_SAMPLE_INTERVAL. Dutycycle
+	is kept in hundredths of a percent, so small corrections accumulate between
+	whole percents.
+*/
+class SpeedController
+{
+public:
+
+	SpeedController();
+
+	bool enable(long targetRpm, int dutyCycle);
+	void disable();
+	bool isEnabled() const;
+	int update(unsigned int rpm);
+
+	unsigned int getTargetRpm() const;
+	int getError() const;
+	bool isSettled() const;
+	unsigned long getSettlingTime() const;
+
+private:
+
+	bool _enabled;
+	uint16_t _targetRpm;
+	long _integral; //Hundredths of dutycycle percent
+	int _error; //Measured RPM - target RPM
+	uint8_t _inTolerance; //Successive updates within the tolerance
+	bool _settled;
+	unsigned long _targetChanged;
+	unsigned long _inToleranceSince;
+	unsigned long _settlingTime;
+};
+
+#endif
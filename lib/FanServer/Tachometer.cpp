@@ -0,0 +1,179 @@
+#include "Tachometer.hpp"
+
+#define PORT_COUNT 3 //Pin-change interrupt ports: PCINT0 = PORTB, PCINT1 = PORTC, PCINT2 = PORTD
+
+//Shared with the interrupt handlers. A slot is free when its mask is 0.
+static volatile uint16_t pulseCounts[MAX_TACHOMETERS];
+static uint8_t slotPorts[MAX_TACHOMETERS];
+static uint8_t slotMasks[MAX_TACHOMETERS];
+static uint8_t portStates[PORT_COUNT];
+
+/**
+	Counts falling edges of the tachometer pins of a port. Called from the pin-change interrupts.
+
+	@param port: Index of the pin-change interrupt
+	@param state: Input register of the port
+*/
+static void countPulses(uint8_t port, uint8_t state)
+{
+	uint8_t falling = portStates[port] & ~state;
+	portStates[port] = state;
+	for (uint8_t i=0; i<MAX_TACHOMETERS; i++) {
+		if (slotPorts[i] == port && (falling & slotMasks[i])) pulseCounts[i]++;
+	}
+}
+
+ISR(PCINT0_vect)
+{
+	countPulses(0, PINB);
+}
+
+ISR(PCINT1_vect)
+{
+	countPulses(1, PINC);
+}
+
+ISR(PCINT2_vect)
+{
+	countPulses(2, PIND);
+}
+
+
+Tachometer::Tachometer()
+: _slot(-1), _pin(0), _pulsesPerRevolution(DEFAULT_PULSES_PER_REVOLUTION),
+_counts{}, _times{}, _sampleIndex(0), _sampleCount(0), _lastSample(0), _rpm(0)
+{
+}
+
+/**
+	Starts counting pulses of the pin. The pin is pulled up, as fans have open collector outputs.
+
+	@param pin: Digital pin of the tachometer output
+	@param pulsesPerRevolution: Pulses the fan gives per revolution, usually 2
+	@return false if the pin has no pin-change interrupt, pulses per revolution
+		is invalid or all counters are in use
+*/
+bool Tachometer::begin(uint8_t pin, uint8_t pulsesPerRevolution)
+{
+	volatile uint8_t* pcicr = digitalPinToPCICR(pin);
+	if (!pcicr || pulsesPerRevolution < 1 || pulsesPerRevolution > MAX_PULSES_PER_REVOLUTION) return false;
+
+	end();
+	for (uint8_t i=0; i<MAX_TACHOMETERS && _slot < 0; i++) {
+		if (slotMasks[i] == 0) _slot = i;
+	}
+	if (_slot < 0) return false;
+
+	uint8_t port = digitalPinToPCICRbit(pin);
+	pinMode(pin, INPUT_PULLUP);
+
+	uint8_t oldSREG = SREG;
+	cli();
+	pulseCounts[_slot] = 0;
+	slotPorts[_slot] = port;
+	slotMasks[_slot] = digitalPinToBitMask(pin);
+	portStates[port] = *portInputRegister(digitalPinToPort(pin));
+	*digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+	*pcicr |= _BV(port);
+	SREG = oldSREG;
+
+	_pin = pin;
+	_pulsesPerRevolution = pulsesPerRevolution;
+	_sampleIndex = 0;
+	_sampleCount = 0;
+	_rpm = 0;
+	return true;
+}
+
+/**
+	Stops counting and frees the counter. The pin-change interrupt of the port
+	is disabled when no other tachometer uses it.
+*/
+void Tachometer::end()
+{
+	if (_slot < 0) return;
+
+	uint8_t oldSREG = SREG;
+	cli();
+	volatile uint8_t* pcmsk = digitalPinToPCMSK(_pin);
+	*pcmsk &= ~_BV(digitalPinToPCMSKbit(_pin));
+	if (*pcmsk == 0) *digitalPinToPCICR(_pin) &= ~_BV(digitalPinToPCICRbit(_pin));
+	slotMasks[_slot] = 0;
+	SREG = oldSREG;
+
+	_slot = -1;
+	_rpm = 0;
+}
+
+bool Tachometer::isActive() const
+{
+	return _slot >= 0;
+}
+
+/**
+	@return True if RPM is measured over a whole window
+*/
+bool Tachometer::isReady() const
+{
+	return _slot >= 0 && _sampleCount >= TACH_WINDOW_LENGTH;
+}
+
+/**
+	@param pulsesPerRevolution: Pulses the fan gives per revolution
+	@return false if out of range
+*/
+bool Tachometer::setPulsesPerRevolution(int pulsesPerRevolution)
+{
+	if (pulsesPerRevolution < 1 || pulsesPerRevolution > MAX_PULSES_PER_REVOLUTION) return false;
+	_pulsesPerRevolution = pulsesPerRevolution;
+	return true;
+}
+
+/**
+	Takes snapshot of the pulse count every TACH_SAMPLE_INTERVAL ms and updates
+	RPM from the pulses in the window. Intended to call from the main-loop.
+
+	@return True if RPM was updated
+*/
+bool Tachometer::sample()
+{
+	if (_slot < 0 || millis() - _lastSample < TACH_SAMPLE_INTERVAL) return false;
+	_lastSample = millis();
+
+	//16-bit counter cannot be read atomically while the interrupt may change it
+	uint8_t oldSREG = SREG;
+	cli();
+	uint16_t count = pulseCounts[_slot];
+	SREG = oldSREG;
+
+	_counts[_sampleIndex] = count;
+	_times[_sampleIndex] = _lastSample;
+	uint8_t newest = _sampleIndex;
+	_sampleIndex = (_sampleIndex + 1) % TACH_WINDOW_LENGTH;
+	if (_sampleCount < TACH_WINDOW_LENGTH) _sampleCount++;
+	if (_sampleCount < 2) return false;
+
+	uint8_t oldest = (_sampleIndex + TACH_WINDOW_LENGTH - _sampleCount) % TACH_WINDOW_LENGTH;
+	uint16_t pulses = _counts[newest] - _counts[oldest];
+	uint16_t elapsed = _times[newest] - _times[oldest];
+	_rpm = (unsigned long)pulses * 60000 / ((unsigned long)elapsed * _pulsesPerRevolution);
+	return true;
+}
+
+uint8_t Tachometer::getPin() const
+{
+	return _pin;
+}
+
+uint8_t Tachometer::getPulsesPerRevolution() const
+{
+	return _pulsesPerRevolution;
+}
+
+/**
+	@return Revolutions per minute over the last window, 0 if not measured
+*/
+unsigned int Tachometer::getRpm() const
+{
+	return _rpm;
+}
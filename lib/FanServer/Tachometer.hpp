@@ -0,0 +1,47 @@
+#ifndef Tachometer_h
+#define Tachometer_h
+
+#define MAX_TACHOMETERS 3
+#define TACH_SAMPLE_INTERVAL 500 //ms between snapshots of the pulse count
+#define TACH_WINDOW_LENGTH 5 //Snapshots in the sliding window, spanning 2 seconds
+#define DEFAULT_PULSES_PER_REVOLUTION 2
+#define MAX_PULSES_PER_REVOLUTION 8
+
+#include <Arduino.h>
+
+/**
+	Measures speed of a fan from its tachometer output. Falling edges are counted
+	with pin-change interrupts, so any digital pin can be used. The main-loop only
+	takes snapshots of the count, and RPM is computed over a sliding window of them.
+*/
+class Tachometer
+{
+public:
+
+	Tachometer();
+
+	bool begin(uint8_t pin, uint8_t pulsesPerRevolution);
+	void end();
+	bool isActive() const;
+	bool isReady() const;
+	bool setPulsesPerRevolution(int pulsesPerRevolution);
+	bool sample();
+
+	uint8_t getPin() const;
+	uint8_t getPulsesPerRevolution() const;
+	unsigned int getRpm() const;
+
+private:
+
+	int8_t _slot; //Index of the interrupt counter, -1 when not in use
+	uint8_t _pin;
+	uint8_t _pulsesPerRevolution;
+	uint16_t _counts[TACH_WINDOW_LENGTH];
+	uint16_t _times[TACH_WINDOW_LENGTH]; //Low bits of millis(), enough for the window
+	uint8_t _sampleIndex;
+	uint8_t _sampleCount;
+	unsigned long _lastSample;
+	unsigned int _rpm;
+};
+
+#endif
@@ -1,10 +1,23 @@
 #ifndef ArduinoServerInterface_h
 #define ArduinoServerInterface_h
-#include <EthernetClient.h>
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
 
 class ArduinoServerInterface {
 public:
-	virtual void handleRequest(const String& request, EthernetClient& client) = 0;
+	/**
+		Handles a parsed request. A handler that cannot answer yet calls response.defer()
+		and returns without writing. The request buffer is then given to other connections,
+		so the value given to defer must hold everything needed to answer the request.
+	*/
+	virtual void handleRequest(const HttpRequest& request, HttpResponse& response) = 0;
+
+	/**
+		Continues a deferred request on the following rounds of the main-loop until
+		it is answered. The value given to defer is available from response.getContext().
+		Servers that never defer a request do not need to override this.
+	*/
+	virtual void resumeRequest(HttpResponse& response) {}
 };
 
 #endif
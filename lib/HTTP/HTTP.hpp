@@ -1,7 +1,9 @@
 #ifndef HTTP_h
 #define HTTP_h
 
-#include <EthernetClient.h>
+#include <Print.h>
+
+class HttpResponse;
 
 enum class HTTPMethod
 {
@@ -18,17 +20,17 @@ enum class HTTPResponseType
 	HTTP_201_CREATED,
 	HTTP_204_NO_CONTENT,
 	HTTP_400_BAD_REQUEST,
-	HTTP_404_NOT_FOUND
+	HTTP_404_NOT_FOUND,
+	HTTP_414_URI_TOO_LONG,
+	HTTP_503_SERVICE_UNAVAILABLE
 };
 
 class HTTP
 {
 public:
 
-	static void sendHttpResponse(EthernetClient& client, HTTPResponseType type);
-	static int parseRequestParameterIntValue(const String& request, const String& parameter);
-	static String parseRequestPath(const String& request, int pathIndex);
-	static HTTPMethod getRequestMethod(const String& request);
+	static void sendHttpResponse(HttpResponse& response, HTTPResponseType type);
+	static void writeHeaders(Print& out, HTTPResponseType type, bool keepAlive);
 
 private:
 	HTTP() {}
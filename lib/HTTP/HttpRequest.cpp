@@ -0,0 +1,280 @@
+#include "HttpRequest.hpp"
+#include <errno.h>
+#include <limits.h>
+
+#define HTTP_GET PSTR("GET")
+#define HTTP_POST PSTR("POST")
+#define HTTP_PUT PSTR("PUT")
+#define HTTP_DELETE PSTR("DELETE")
+#define HTTP_VERSION_PREFIX PSTR("HTTP/")
+#define HTTP_VERSION_1_0 PSTR("HTTP/1.0")
+
+
+HttpRequest::HttpRequest()
+{
+	clear();
+}
+
+/**
+	Empties the request so the buffer can be reused for the next request.
+*/
+void HttpRequest::clear()
+{
+	_line[0] = '\0';
+	_length = 0;
+	_complete = false;
+	_tooLong = false;
+	_method = HTTPMethod::UNKNOWN;
+	_persistent = false;
+	_pathSegmentCount = 0;
+	_parameterCount = 0;
+}
+
+/**
+	Appends a character to the first line of the request. Characters that do
+	not fit in the buffer are skipped until the end of the line, so the headers
+	are read after a too long line as usual.
+
+	@param c: Character received from the client
+	@return True if the line is complete, otherwise false
+*/
+bool HttpRequest::append(char c)
+{
+	if (_complete) return true;
+
+	if (_length < REQUEST_LINE_SIZE) {
+		_line[_length++] = c;
+		_line[_length] = '\0';
+	} else {
+		_tooLong = true;
+	}
+	_complete = c == '\n';
+	return _complete;
+}
+
+/**
+	@return True if the first line did not fit in REQUEST_LINE_SIZE characters.
+*/
+bool HttpRequest::isTooLong() const
+{
+	return _tooLong;
+}
+
+/**
+	@return First line of the request as received. Only valid before parse() is called.
+*/
+const char* HttpRequest::getLine() const
+{
+	return _line;
+}
+
+/**
+	Splits the first line of a HTTP-request into method, path segments and
+	query parameters in a single pass. Delimiters are replaced with
+	terminating null characters, so every part can be used as a C-string.
+
+	Example:
+	line = "GET /fans/config?pin=3&dutycycle=50 HTTP/1.1"
+	method: GET, path segments: "fans", "config", parameters: pin=3, dutycycle=50
+
+	@return True if the line is a valid request line with at most MAX_PATH_SEGMENTS
+		path segments and MAX_REQUEST_PARAMETERS parameters, otherwise false
+*/
+bool HttpRequest::parse()
+{
+	if (_tooLong) return false;
+
+	enum class Token { METHOD, PATH, PARAMETER_NAME, PARAMETER_VALUE, VERSION };
+
+	Token token = Token::METHOD;
+	uint8_t versionStart = 0;
+	int8_t parameter = -1;
+
+	for (uint8_t i=0; i<_length; i++) {
+		char c = _line[i];
+		if (c == '\r' || c == '\n') {
+			_line[i] = '\0';
+			break;
+		}
+
+		switch (token) {
+			case Token::METHOD:
+				if (c == ' ') {
+					_line[i] = '\0';
+					if (_line[i + 1] != '/') return false;
+					token = Token::PATH;
+				}
+				break;
+			case Token::PATH:
+				if (c == '/') {
+					_line[i] = '\0';
+					if (_pathSegmentCount == MAX_PATH_SEGMENTS) return false;
+					_pathSegments[_pathSegmentCount++] = i + 1;
+				} else if (c == '?' || c == ' ') {
+					_line[i] = '\0';
+					token = (c == '?') ? Token::PARAMETER_NAME : Token::VERSION;
+				}
+				break;
+			case Token::PARAMETER_NAME:
+				if (c == '=') {
+					_line[i] = '\0';
+					if (parameter >= 0) _parameterValues[parameter] = i + 1;
+					token = Token::PARAMETER_VALUE;
+					break;
+				}
+				// fall through, parameter without value
+			case Token::PARAMETER_VALUE:
+				if (c == '&' || c == ' ') {
+					_line[i] = '\0';
+					parameter = -1;
+					token = (c == '&') ? Token::PARAMETER_NAME : Token::VERSION;
+				}
+				break;
+			case Token::VERSION:
+				break;
+		}
+
+		//Start of a new parameter, value points to the terminating null until '=' is found
+		if (token == Token::PARAMETER_NAME && parameter < 0) {
+			if (_parameterCount == MAX_REQUEST_PARAMETERS) return false;
+			parameter = _parameterCount++;
+			_parameterNames[parameter] = i + 1;
+			_parameterValues[parameter] = i;
+		}
+		if (token == Token::VERSION && versionStart == 0) versionStart = i + 1;
+	}
+
+	if (token != Token::VERSION || strncmp_P(&_line[versionStart], HTTP_VERSION_PREFIX, 5) != 0) {
+		return false;
+	}
+	_method = parseMethod(_line);
+	_persistent = strcmp_P(&_line[versionStart], HTTP_VERSION_1_0) != 0;
+	return true;
+}
+
+/**
+	@return True if the client supports persistent connections (HTTP/1.1 or later).
+*/
+bool HttpRequest::isPersistent() const
+{
+	return _persistent;
+}
+
+/**
+	@return HTTPMethod-enum. If no method is recognized, HTTPMethod::UNKNOWN is returned.
+*/
+HTTPMethod HttpRequest::getMethod() const
+{
+	return _method;
+}
+
+/**
+	Gets a segment of the request path.
+
+	@param depth: Depth of the segment, first segment is at depth 1
+	@return Path segment. If no segment is found at specified depth, empty string is returned.
+
+	Example:
+	request = "GET /example/foo/bar HTTP/1.1"
+	depth = 2
+	returns "foo"
+*/
+const char* HttpRequest::getPathSegment(uint8_t depth) const
+{
+	if (depth > 0 && depth <= _pathSegmentCount) {
+		return &_line[_pathSegments[depth - 1]];
+	}
+	return "";
+}
+
+/**
+	Compares a segment of the request path.
+
+	@param depth: Depth of the segment, first segment is at depth 1
+	@param segment: Expected segment
+	@return True if the segment at specified depth equals to segment
+*/
+bool HttpRequest::isPath(uint8_t depth, const __FlashStringHelper* segment) const
+{
+	return strcmp_P(getPathSegment(depth), reinterpret_cast<PGM_P>(segment)) == 0;
+}
+
+/**
+	Finds value of a query parameter.
+
+	@param name: Name of the parameter
+	@return Value of the parameter, empty string if the parameter has no value.
+		If the parameter is not found, returns nullptr.
+*/
+const char* HttpRequest::getParameter(const __FlashStringHelper* name) const
+{
+	for (uint8_t i=0; i<_parameterCount; i++) {
+		if (strcmp_P(&_line[_parameterNames[i]], reinterpret_cast<PGM_P>(name)) == 0) {
+			return &_line[_parameterValues[i]];
+		}
+	}
+	return nullptr;
+}
+
+/**
+	Finds int value of a query parameter.
+
+	@param name: Name of the parameter
+	@param outValue: Value of the parameter, "Output variable". Unchanged unless valid.
+	@return MISSING if the parameter was not sent, INVALID if it is not an integer
+		or does not fit to an int, otherwise VALID.
+
+	Example:
+	request = "GET /example?foo=1&bar=-2&baz=2x HTTP/1.1"
+	name = "bar" returns VALID, outValue = -2
+	name = "baz" returns INVALID
+*/
+ParameterResult HttpRequest::getParameter(const __FlashStringHelper* name, int& outValue) const
+{
+	long value;
+	ParameterResult result = getParameter(name, value);
+	if (result != ParameterResult::VALID) return result;
+	if (value < INT_MIN || value > INT_MAX) return ParameterResult::INVALID;
+
+	outValue = value;
+	return ParameterResult::VALID;
+}
+
+/**
+	Finds long value of a query parameter.
+
+	@param name: Name of the parameter
+	@param outValue: Value of the parameter, "Output variable". Unchanged unless valid.
+	@return MISSING if the parameter was not sent, INVALID if it is not an integer
+		or does not fit to a long, otherwise VALID.
+*/
+ParameterResult HttpRequest::getParameter(const __FlashStringHelper* name, long& outValue) const
+{
+	const char* value = getParameter(name);
+	if (!value) return ParameterResult::MISSING;
+	if (*value == '\0') return ParameterResult::INVALID;
+
+	char* end;
+	errno = 0;
+	long parsed = strtol(value, &end, 10);
+	if (*end != '\0' || errno == ERANGE) return ParameterResult::INVALID;
+
+	outValue = parsed;
+	return ParameterResult::VALID;
+}
+
+/**
+	Parses the HTTP-method.
+
+	@param method: Method part of the request line
+	@return HTTPMethod-enum. If no method is recognized, HTTPMethod::UNKNOWN is returned.
+*/
+HTTPMethod HttpRequest::parseMethod(const char* method) const
+{
+	if (strcmp_P(method, HTTP_GET) == 0) return HTTPMethod::GET;
+	if (strcmp_P(method, HTTP_POST) == 0) return HTTPMethod::POST;
+	if (strcmp_P(method, HTTP_PUT) == 0) return HTTPMethod::PUT;
+	if (strcmp_P(method, HTTP_DELETE) == 0) return HTTPMethod::DELETE;
+
+	return HTTPMethod::UNKNOWN;
+}
@@ -0,0 +1,60 @@
+#ifndef HttpRequest_h
+#define HttpRequest_h
+
+#define REQUEST_LINE_SIZE 128
+#define MAX_PATH_SEGMENTS 3
+#define MAX_REQUEST_PARAMETERS 10
+
+#include <Arduino.h>
+#include "HTTP.hpp"
+
+enum class ParameterResult : uint8_t
+{
+	MISSING,
+	INVALID, //Present but not a number in range
+	VALID
+};
+
+/**
+	First line of a HTTP-request stored in a fixed size buffer. parse() splits
+	the line in place into method, path segments and query parameters, so
+	accessing them needs no heap allocations.
+*/
+class HttpRequest
+{
+public:
+
+	HttpRequest();
+
+	void clear();
+	bool append(char c);
+	bool isTooLong() const;
+	const char* getLine() const;
+	bool parse();
+	bool isPersistent() const;
+
+	HTTPMethod getMethod() const;
+	const char* getPathSegment(uint8_t depth) const;
+	bool isPath(uint8_t depth, const __FlashStringHelper* segment) const;
+	const char* getParameter(const __FlashStringHelper* name) const;
+	ParameterResult getParameter(const __FlashStringHelper* name, int& outValue) const;
+	ParameterResult getParameter(const __FlashStringHelper* name, long& outValue) const;
+
+private:
+
+	char _line[REQUEST_LINE_SIZE + 1];
+	uint8_t _length;
+	bool _complete;
+	bool _tooLong;
+	HTTPMethod _method;
+	bool _persistent;
+	uint8_t _pathSegments[MAX_PATH_SEGMENTS];
+	uint8_t _pathSegmentCount;
+	uint8_t _parameterNames[MAX_REQUEST_PARAMETERS];
+	uint8_t _parameterValues[MAX_REQUEST_PARAMETERS];
+	uint8_t _parameterCount;
+
+	HTTPMethod parseMethod(const char* method) const;
+};
+
+#endif
@@ -1,27 +1,35 @@
 #include "HttpRequestHandler.hpp"
+#include <utility/socket.h>
+
+//Lowercase header line that asks to close the connection after the response
+static const char CONNECTION_CLOSE_HEADER[] PROGMEM = "connection: close";
 
 
 HttpRequestHandler::HttpRequestHandler()
-: _serverPaths{}, _serverPathCount(0)
+: _port(0), _serverPaths{}, _serverPathCount(0), _connections{}, _requestOwner(nullptr)
 {
 }
 
 /**
-	Initalizes server and requests a DHCP-lease.
+	Initalizes server and requests a DHCP-lease. The lease is printed to Serial if DEBUG_SERIAL is defined.
 
 	@param portNumber: Number of the port where the server runs
 	@param macAddress: MAC-address used for DHCP-request, byte[6]
 */
 void HttpRequestHandler::init(int portNumber, byte* macAddress)
 {
+#ifdef DEBUG_SERIAL
 	Serial.println();
 	Serial.println(F("Trying to obtain DHCP-lease"));
+#endif
 	Ethernet.begin(macAddress);
+#ifdef DEBUG_SERIAL
 	Serial.print(F("Received DHCP-lease, IP-address: "));
 	Serial.println(Ethernet.localIP());
+#endif
 
+	_port = portNumber;
 	_ethServer = EthernetServer(portNumber);
-	_requestBuffer = String(REQUEST_BUFFER_SIZE);
 }
 
 /**
@@ -67,75 +75,347 @@ bool HttpRequestHandler::removeRoute(const String &path)
 }
 
 /**
-	Checks for new clients and handles request when present. Also maintains DHCP-lease.
+	Accepts new clients and moves every open connection forward by one step,
+	so a slow client does not hold up the others. Also maintains DHCP-lease.
 	Intended to call run-method from the main-loop.
 */
 void HttpRequestHandler::run()
 {
-	EthernetClient client = _ethServer.available();
-	if (client) {
-		handleRequest(client);
+	acceptConnections();
+	for (HttpConnection& connection : _connections) {
+		if (connection.state != ConnectionState::FREE) {
+			serviceConnection(connection);
+		}
 	}
 	Ethernet.maintain();
 }
 
 /**
-	Parses the request-path and directs the request to the correct server.
-	If the path is not recognized, sends 404 Not found to client.
+	Goes through the sockets of the network card, adds newly connected clients
+	to _connections and makes sure that one socket is always listening for new clients.
+	If all connection slots are in use, new clients wait in the network card's queue.
+*/
+void HttpRequestHandler::acceptConnections()
+{
+	bool listening = false;
 
-	@param client: EthernetClient where the request originated
+	for (uint8_t socket=0; socket<MAX_SOCK_NUM; socket++) {
+		if (EthernetClass::_server_port[socket] != _port) continue;
+
+		uint8_t status = EthernetClient(socket).status();
+		if (status == SnSR::LISTEN) {
+			listening = true;
+		} else if ((status == SnSR::ESTABLISHED || status == SnSR::CLOSE_WAIT) && !findConnection(socket)) {
+			HttpConnection* connection = findFreeConnection();
+			if (connection) {
+				connection->socket = socket;
+				connection->requestCount = 0;
+				setState(*connection, ConnectionState::READING_REQUEST);
+			}
+		}
+	}
+
+	if (!listening) _ethServer.begin();
+}
+
+/**
+	Advances the state of a single connection without blocking. Processes the
+	data that is available right now and answers every request that is complete.
+	A new request is read only when the shared request buffer is free, otherwise
+	its data waits in the network card until the request being handled is answered.
+
+	@param connection: Connection to be serviced
 */
-void HttpRequestHandler::handleRequest(EthernetClient& client)
+void HttpRequestHandler::serviceConnection(HttpConnection& connection)
 {
-	getFirstRequestLine(client, _requestBuffer);
+	EthernetClient client(connection.socket);
 
-	Serial.println(F("First line of request:"));
-	Serial.println(_requestBuffer);
-	Serial.println();
+	if (connection.state == ConnectionState::CLOSING) {
+		uint8_t status = client.status();
+		if (status != SnSR::CLOSED && millis() - connection.stateChanged > CLOSE_TIMEOUT) {
+			close(connection.socket);
+			status = SnSR::CLOSED;
+		}
+		if (status == SnSR::CLOSED) releaseConnection(connection);
+		return;
+	}
+
+	if (connection.state == ConnectionState::DEFERRED) {
+		if (client.status() == SnSR::CLOSED) {
+			releaseConnection(connection);
+		} else {
+			resume(client, connection);
+		}
+		return;
+	}
+
+	bool waiting = connection.state == ConnectionState::READING_REQUEST && _requestOwner && _requestOwner != &connection;
+	while (!waiting && (connection.state == ConnectionState::READING_REQUEST || connection.state == ConnectionState::READING_HEADERS)
+			&& (_reader.available() || _reader.fill(client) > 0)) {
+		char c = _reader.read();
+		if (connection.state == ConnectionState::READING_REQUEST) {
+			_requestOwner = &connection;
+			if (_request.append(c)) {
+				connection.headerPosition = 0;
+				connection.headerMatch = true;
+				connection.closeRequested = false;
+				setState(connection, ConnectionState::READING_HEADERS);
+			}
+		} else if (readHeader(connection, c)) {
+			respond(client, connection);
+		}
+	}
+
+	if (connection.state == ConnectionState::READING_REQUEST || connection.state == ConnectionState::READING_HEADERS) {
+		uint8_t status = client.status();
+		bool idle = connection.state == ConnectionState::READING_REQUEST && _requestOwner != &connection && connection.requestCount > 0;
+		unsigned long timeout = idle ? KEEP_ALIVE_TIMEOUT : REQUEST_TIMEOUT;
+		//Time spent waiting for the request buffer does not count towards the timeouts
+		bool pending = waiting && client.available() > 0;
+		if (pending) connection.stateChanged = millis();
 
-	//Test that assumed request isn't actually response
-	if (_requestBuffer.indexOf(F("HTTP")) > 3) {
-		String path = HTTP::parseRequestPath(_requestBuffer, 1);
-		if (!(passRequestToServer(path, _requestBuffer, client))) {
-			HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_404_NOT_FOUND);
+		if (status == SnSR::CLOSED) {
+			releaseConnection(connection);
+		} else if (!pending && (status == SnSR::CLOSE_WAIT || millis() - connection.stateChanged > timeout)) {
+			closeConnection(connection);
 		}
-		client.stop();
-		_requestBuffer.remove(0);
 	}
 }
 
 /**
-	Passes request and client to server. Goes through _serverPaths and tries to find matching path.
+	Processes a character of the request headers. Headers are skipped except
+	for "Connection: close", which is remembered in connection.closeRequested.
 
-	@param path: Path to server, Non-empty String
-	@param request:	First line of the HTTP-request
-	@param client: Client where the request originated from
-	@return True if server with correct path was found, false if not
+	@param connection: Connection where the character was received
+	@param c: Received character
+	@return True if the empty line ending the headers was received, otherwise false
 */
-bool HttpRequestHandler::passRequestToServer(const String &path, const String &request, EthernetClient &client)
+bool HttpRequestHandler::readHeader(HttpConnection& connection, char c)
 {
-	for (int i=0; i<_serverPathCount; i++) {
-		if (_serverPaths[i].path.equals(path)) {
-			_serverPaths[i].server->handleRequest(request, client);
-			return true;
+	if (c == '\n') {
+		bool endOfHeaders = connection.headerPosition == 0;
+		connection.headerPosition = 0;
+		connection.headerMatch = true;
+		return endOfHeaders;
+	}
+	if (c == '\r') return false;
+
+	if (connection.headerMatch) {
+		char expected = pgm_read_byte(&CONNECTION_CLOSE_HEADER[connection.headerPosition]);
+		connection.headerMatch = expected != '\0' && tolower(c) == expected;
+		if (connection.headerMatch && pgm_read_byte(&CONNECTION_CLOSE_HEADER[connection.headerPosition + 1]) == '\0') {
+			connection.closeRequested = true;
 		}
 	}
+	if (connection.headerPosition < UINT8_MAX) connection.headerPosition++;
 	return false;
 }
 
 /**
-	Parses the first line of a HTTP-request from a Ethernet-client.
+	Parses a complete request and passes it to the server. A request line that
+	is too long is answered with 414 and a malformed one with 400, after which
+	the connection is closed.
 
-	@param client: EthernetClient where the request originates
-	@param outRequest: String where the first line of the request is stored, "Output variable"
+	@param client: Client where the request originated
+	@param connection: Connection where the request was received
 */
-void HttpRequestHandler::getFirstRequestLine(EthernetClient &client, String& outRequest) {
-	while (!outRequest.endsWith("\n") && client.available()) {
-		char c = client.read();
-		outRequest += c;
+void HttpRequestHandler::respond(EthernetClient& client, HttpConnection& connection)
+{
+	if (_request.isTooLong()) return reject(client, connection, HTTPResponseType::HTTP_414_URI_TOO_LONG);
+	if (!_request.parse()) return reject(client, connection, HTTPResponseType::HTTP_400_BAD_REQUEST);
+
+	connection.requestCount++;
+	connection.keepAlive = !connection.closeRequested && connection.requestCount < MAX_KEEP_ALIVE_REQUESTS
+		&& _request.isPersistent();
+	dispatch(client, connection);
+}
+
+/**
+	Directs a parsed request to the correct server and either waits for the next
+	request on the same connection or closes the connection. If the server defers
+	the response, the connection keeps only the server and its context and the
+	request buffer is freed for the other connections. If the path is not
+	recognized, sends 404 Not found to client.
+
+	@param client: Client where the request originated
+	@param connection: Connection where the request was received
+*/
+void HttpRequestHandler::dispatch(EthernetClient& client, HttpConnection& connection)
+{
+	ArduinoServerInterface* server = findServer(_request.getPathSegment(1));
+
+	_response.begin(connection.socket, connection.keepAlive);
+	if (server) {
+		server->handleRequest(_request, _response);
+	} else {
+		HTTP::sendHttpResponse(_response, HTTPResponseType::HTTP_404_NOT_FOUND);
+	}
+
+	if (_response.isDeferred()) {
+		connection.server = server;
+		connection.context = _response.getContext();
+		//Pipelined data in the reader would be read as the next connection's
+		if (_reader.available()) connection.keepAlive = false;
+		setState(connection, ConnectionState::DEFERRED);
+		if (!connection.keepAlive) _reader.discard(client);
+		releaseRequest(connection);
+		return;
+	}
+	finishResponse(connection);
+}
+
+/**
+	Gives a deferred request back to its server on each run until the server
+	answers or DEFERRED_TIMEOUT passes, after which 503 is sent to the client.
+
+	@param client: Client where the request originated
+	@param connection: Connection whose request was deferred
+*/
+void HttpRequestHandler::resume(EthernetClient& client, HttpConnection& connection)
+{
+	_response.begin(connection.socket, connection.keepAlive);
+	_response.resume(connection.context);
+	connection.server->resumeRequest(_response);
+
+	if (_response.isDeferred()) {
+		connection.context = _response.getContext();
+		if (millis() - connection.stateChanged <= DEFERRED_TIMEOUT) return;
+
+		_response.begin(connection.socket, false);
+		HTTP::sendHttpResponse(_response, HTTPResponseType::HTTP_503_SERVICE_UNAVAILABLE);
+	}
+	finishResponse(connection);
+}
+
+/**
+	Ends the response and either waits for the next request on the same connection or closes it.
+
+	@param connection: Connection that was answered
+*/
+void HttpRequestHandler::finishResponse(HttpConnection& connection)
+{
+	if (_response.end()) {
+		releaseRequest(connection);
+		setState(connection, ConnectionState::READING_REQUEST);
+	} else {
+		closeConnection(connection);
 	}
+}
+
+/**
+	Sends an error response to a request that could not be parsed and closes the connection.
+
+	@param client: Client where the request originated
+	@param connection: Connection where the request was received
+	@param type: HTTP-response type of the error
+*/
+void HttpRequestHandler::reject(EthernetClient& client, HttpConnection& connection, HTTPResponseType type)
+{
+	_response.begin(connection.socket, false);
+	HTTP::sendHttpResponse(_response, type);
+	_response.end();
+	closeConnection(connection);
+}
+
+/**
+	Finds connection that is bound to a socket.
+
+	@param socket: Socket number of the network card
+	@return HttpConnection*, if no connection is found returns nullptr.
+*/
+HttpConnection* HttpRequestHandler::findConnection(uint8_t socket)
+{
+	for (HttpConnection& connection : _connections) {
+		if (connection.state != ConnectionState::FREE && connection.socket == socket) {
+			return &connection;
+		}
+	}
+	return nullptr;
+}
+
+/**
+	Finds unused slot from _connections.
+
+	@return HttpConnection*, if all slots are in use returns nullptr.
+*/
+HttpConnection* HttpRequestHandler::findFreeConnection()
+{
+	for (HttpConnection& connection : _connections) {
+		if (connection.state == ConnectionState::FREE) {
+			return &connection;
+		}
+	}
+	return nullptr;
+}
+
+/**
+	Changes state of a connection and records the time of the change for timeouts.
+
+	@param connection: Connection whose state is changed
+	@param state: New state
+*/
+void HttpRequestHandler::setState(HttpConnection& connection, ConnectionState state)
+{
+	connection.state = state;
+	connection.stateChanged = millis();
+}
+
+/**
+	Discards unread input and sends FIN to the client. The socket is released
+	later in serviceConnection, so waiting for the client does not block the loop.
+
+	@param connection: Connection to be closed
+*/
+void HttpRequestHandler::closeConnection(HttpConnection& connection)
+{
+	EthernetClient client(connection.socket);
 	//Read rest of the request from network card's buffer
-	while (client.available()) client.read();
+	_reader.discard(client);
+
+	disconnect(connection.socket);
+	releaseRequest(connection);
+	setState(connection, ConnectionState::CLOSING);
+}
+
+/**
+	Frees connection slot and returns the socket to the Ethernet library.
+
+	@param connection: Connection to be released
+*/
+void HttpRequestHandler::releaseConnection(HttpConnection& connection)
+{
+	EthernetClass::_server_port[connection.socket] = 0;
+	releaseRequest(connection);
+	setState(connection, ConnectionState::FREE);
+}
+
+/**
+	Empties the shared request buffer and lets the next connection read its
+	request into it. Does nothing if another connection holds the buffer.
+
+	@param connection: Connection whose request is finished
+*/
+void HttpRequestHandler::releaseRequest(HttpConnection& connection)
+{
+	if (_requestOwner != &connection) return;
+	_request.clear();
+	_requestOwner = nullptr;
+}
+
+/**
+	Finds the server of a path. Goes through _serverPaths and tries to find matching path.
+
+	@param path: First segment of the request path
+	@return Server with the path, nullptr if not found
+*/
+ArduinoServerInterface* HttpRequestHandler::findServer(const char* path)
+{
+	for (int i=0; i<_serverPathCount; i++) {
+		if (_serverPaths[i].path.equals(path)) {
+			return _serverPaths[i].server;
+		}
+	}
+	return nullptr;
 }
 
 /**
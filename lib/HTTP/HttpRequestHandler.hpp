@@ -2,11 +2,20 @@
 #define HttpRequestHandler_h
 
 #define MAX_SERVERS 3
-#define REQUEST_BUFFER_SIZE 80
+#define MAX_CONNECTIONS 4
+#define REQUEST_TIMEOUT 2000 //ms to receive request line and headers
+#define KEEP_ALIVE_TIMEOUT 5000 //ms to wait for the next request on an open connection
+#define MAX_KEEP_ALIVE_REQUESTS 100
+#define CLOSE_TIMEOUT 1000 //ms to wait for the peer to acknowledge FIN
+#define DEFERRED_TIMEOUT 3000 //ms a deferred request may wait for its response
+//#define DEBUG_SERIAL //Prints the DHCP-lease to Serial, which takes about 175 bytes of RAM
 
 #include <Ethernet2.h>
 #include "ArduinoServerInterface.hpp"
 #include "HTTP.hpp"
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
+#include "SocketReader.hpp"
 
 struct ServerPath
 {
@@ -14,6 +23,29 @@ struct ServerPath
 	ArduinoServerInterface* server;
 };
 
+enum class ConnectionState
+{
+	FREE,
+	READING_REQUEST,
+	READING_HEADERS,
+	DEFERRED,
+	CLOSING
+};
+
+struct HttpConnection
+{
+	uint8_t socket;
+	ConnectionState state;
+	unsigned long stateChanged;
+	uint8_t requestCount;
+	uint8_t headerPosition;
+	bool headerMatch;
+	bool closeRequested;
+	bool keepAlive;
+	ArduinoServerInterface* server; //Server of a deferred request
+	unsigned long context; //Given to the server when a deferred request is resumed
+};
+
 class HttpRequestHandler
 {
 
@@ -28,13 +60,31 @@ public:
 private:
 
 	EthernetServer _ethServer = 0;
+	uint16_t _port;
 	ServerPath _serverPaths[MAX_SERVERS];
 	int _serverPathCount;
-	String _requestBuffer;
+	HttpConnection _connections[MAX_CONNECTIONS];
+	HttpRequest _request; //Shared by the connections, one request is read and answered at a time
+	HttpConnection* _requestOwner; //Connection whose request is in _request, nullptr when free
+	SocketReader _reader;
+	HttpResponse _response;
+
+	void acceptConnections();
+	void serviceConnection(HttpConnection& connection);
+	bool readHeader(HttpConnection& connection, char c);
+	void respond(EthernetClient& client, HttpConnection& connection);
+	void dispatch(EthernetClient& client, HttpConnection& connection);
+	void resume(EthernetClient& client, HttpConnection& connection);
+	void finishResponse(HttpConnection& connection);
+	void reject(EthernetClient& client, HttpConnection& connection, HTTPResponseType type);
+	HttpConnection* findConnection(uint8_t socket);
+	HttpConnection* findFreeConnection();
+	void setState(HttpConnection& connection, ConnectionState state);
+	void closeConnection(HttpConnection& connection);
+	void releaseConnection(HttpConnection& connection);
+	void releaseRequest(HttpConnection& connection);
 
-	void handleRequest(EthernetClient& client);
-	bool passRequestToServer(const String& path, const String &request, EthernetClient &client);
-	void getFirstRequestLine(EthernetClient& client, String& outRequest);
+	ArduinoServerInterface* findServer(const char* path);
 	bool pathNotInUse(const String& path);
 };
 
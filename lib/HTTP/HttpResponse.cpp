@@ -0,0 +1,322 @@
+#include "HttpResponse.hpp"
+#include <utility/w5500.h>
+
+#define HEADER_SLOT_SIZE 35 //Framing header padded with spaces, empty line and the size line of the first chunk
+#define CHUNK_SLOT_SIZE 7 //CRLF after the previous chunk and the size line of the next one
+#define CHUNK_SIZE_LINE_SIZE 5 //Three hex digits and CRLF, chunks are at most the 2 KB transmit buffer
+#define LAST_CHUNK "\r\n0\r\n\r\n"
+#define LAST_CHUNK_SIZE 7
+
+//Framing header of the response, chosen when the first part of the response is sent
+static const char CONTENT_LENGTH_HEADER[] PROGMEM = "Content-Length: ";
+static const char CHUNKED_HEADER[] PROGMEM = "Transfer-Encoding: chunked";
+//A body that ends when the connection is closed needs no framing, the connection header is repeated instead
+static const char CLOSE_HEADER[] PROGMEM = "Connection: close";
+
+static char hexDigit(uint8_t value)
+{
+	return value < 10 ? '0' + value : 'A' + value - 10;
+}
+
+/**
+	Writes a chunk size line with three hex digits.
+
+	@param size: Size of the chunk
+	@param buffer: Buffer for the line, char[CHUNK_SIZE_LINE_SIZE]
+*/
+static void writeChunkSize(uint16_t size, char buffer[])
+{
+	buffer[0] = hexDigit((size >> 8) & 0x0F);
+	buffer[1] = hexDigit((size >> 4) & 0x0F);
+	buffer[2] = hexDigit(size & 0x0F);
+	buffer[3] = '\r';
+	buffer[4] = '\n';
+}
+
+HttpResponse::HttpResponse()
+: _socket(0), _status(HTTPResponseType::HTTP_200_OK), _keepAlive(false), _headersSent(false), _chunked(false), _deferred(false),
+_context(0), _length(0), _slotSize(0), _slot(0), _room(0), _staged(0)
+{
+}
+
+/**
+	Starts a new response. Unsent data of the previous response is dropped.
+
+	@param socket: Socket of the network card whom the response is sent to
+	@param keepAlive: True if the client may keep the connection open after the response
+*/
+void HttpResponse::begin(uint8_t socket, bool keepAlive)
+{
+	_socket = socket;
+	_status = HTTPResponseType::HTTP_200_OK;
+	_keepAlive = keepAlive;
+	_headersSent = false;
+	_chunked = false;
+	_deferred = false;
+	_context = 0;
+	_length = 0;
+	_slotSize = 0;
+	_staged = 0;
+}
+
+/**
+	Sets status of the response. Must be called before the body is written.
+
+	@param type: HTTP-response type
+*/
+void HttpResponse::setStatus(HTTPResponseType type)
+{
+	_status = type;
+}
+
+/**
+	Marks that the request is answered later. Nothing is sent and the
+	server's resumeRequest is called with the context on the next round.
+
+	@param context: Value the handler gets back with getContext when the request is resumed
+*/
+void HttpResponse::defer(unsigned long context)
+{
+	_deferred = true;
+	_context = context;
+}
+
+/**
+	Gives the context of a deferred response to the handler that resumes it. Called after begin.
+
+	@param context: Value given to defer
+*/
+void HttpResponse::resume(unsigned long context)
+{
+	_context = context;
+}
+
+/**
+	@return True if the handler deferred the response
+*/
+bool HttpResponse::isDeferred() const
+{
+	return _deferred;
+}
+
+/**
+	@return Value given to defer when the request was deferred
+*/
+unsigned long HttpResponse::getContext() const
+{
+	return _context;
+}
+
+/**
+	Appends a character to the body of the response.
+
+	@param c: Character to be sent
+	@return Number of characters written
+*/
+size_t HttpResponse::write(uint8_t c)
+{
+	return write(&c, 1);
+}
+
+/**
+	Appends characters to the body of the response. Headers are written in front
+	of the first characters and the buffer is copied to the network card whenever it fills up.
+
+	@param buffer: Characters to be sent
+	@param size: Number of characters in buffer
+	@return Number of characters written
+*/
+size_t HttpResponse::write(const uint8_t* buffer, size_t size)
+{
+	if (!_headersSent) sendHeaders();
+
+	size_t written = 0;
+	while (written < size) {
+		size_t count = min(size - written, (size_t)(RESPONSE_BUFFER_SIZE - _length));
+		memcpy(&_buffer[_length], &buffer[written], count);
+		_length += count;
+		written += count;
+		if (_length == RESPONSE_BUFFER_SIZE) flush();
+	}
+	return written;
+}
+
+/**
+	Sends the staged response to the client. If nothing of it has been sent
+	yet, it gets a Content-Length, otherwise the chunked body is ended.
+
+	@return True if the connection can be kept open, otherwise false
+*/
+bool HttpResponse::end()
+{
+	if (!_headersSent) sendHeaders();
+
+	flush();
+	send(true);
+	return _keepAlive;
+}
+
+/**
+	Writes status line and headers and reserves a slot for the framing header after
+	them. The slot is filled when the first part of the response is sent, so a response
+	that fits the transmit buffer gets a Content-Length. A response without a body
+	has no framing.
+*/
+void HttpResponse::sendHeaders()
+{
+	//Nothing of this response is staged yet, so the free size of the network card is up to date
+	_room = w5500.getTXFreeSize(_socket);
+	_headersSent = true;
+	HTTP::writeHeaders(*this, _status, _keepAlive);
+
+	if (_status == HTTPResponseType::HTTP_204_NO_CONTENT) {
+		println();
+		return;
+	}
+	flush();
+	if (makeRoom(HEADER_SLOT_SIZE)) reserveSlot(HEADER_SLOT_SIZE);
+}
+
+/**
+	Copies the buffer to the transmit buffer of the network card without sending it.
+	The buffer is dropped if the connection is lost.
+*/
+void HttpResponse::flush()
+{
+	if (_length > 0 && makeRoom(_length)) {
+		w5500.send_data_processing(_socket, _buffer, _length);
+		_room -= _length;
+		_staged += _length;
+	}
+	_length = 0;
+}
+
+/**
+	Makes sure that data and the end of a chunked body fit the transmit buffer.
+	If they do not, the staged part of the response is sent and the next chunk
+	is started once the client has acknowledged enough of it.
+
+	@param size: Bytes to be staged
+	@return False if the connection was lost
+*/
+bool HttpResponse::makeRoom(uint16_t size)
+{
+	size += LAST_CHUNK_SIZE;
+	if (size <= _room) return true;
+
+	//A slot with no data after it is reserved again after the data that is sent now
+	uint8_t slotSize = 0;
+	if (_slotSize > 0 && w5500.readSnTX_WR(_socket) == (uint16_t)(_slot + _slotSize)) {
+		slotSize = _slotSize;
+		w5500.writeSnTX_WR(_socket, _slot);
+		_staged -= slotSize;
+		_slotSize = 0;
+	}
+	send(false);
+	if (_chunked && slotSize == 0) slotSize = CHUNK_SLOT_SIZE;
+
+	_room = waitForRoom(size + slotSize);
+	if (_room < size + slotSize) return false;
+	if (slotSize > 0) reserveSlot(slotSize);
+	return true;
+}
+
+/**
+	Skips over a slot in the transmit buffer. The slot is written in front of the
+	data after it when the data is sent.
+
+	@param size: Size of the slot
+*/
+void HttpResponse::reserveSlot(uint8_t size)
+{
+	_slot = w5500.readSnTX_WR(_socket);
+	w5500.writeSnTX_WR(_socket, _slot + size);
+	_slotSize = size;
+	_room -= size;
+	_staged += size;
+}
+
+/**
+	Fills the reserved slot with the framing of the data staged after it. The slot
+	after the headers gets a Content-Length if the response ends with the data,
+	otherwise the body is chunked on a persistent connection or ends when the
+	connection is closed. A later slot gets the size line of the next chunk.
+
+	@param last: True if the response ends with the staged data
+	@return Number of bytes after the slot
+*/
+uint16_t HttpResponse::fillSlot(bool last)
+{
+	uint16_t end = w5500.readSnTX_WR(_socket);
+	uint16_t size = end - _slot - _slotSize;
+	char slot[HEADER_SLOT_SIZE];
+	memset(slot, ' ', _slotSize);
+
+	if (_slotSize == CHUNK_SLOT_SIZE) {
+		slot[0] = '\r';
+		slot[1] = '\n';
+		writeChunkSize(size, &slot[2]);
+	} else {
+		if (last) {
+			strcpy_P(slot, CONTENT_LENGTH_HEADER);
+			utoa(size, &slot[strlen(slot)], 10);
+		} else {
+			_chunked = _keepAlive;
+			strcpy_P(slot, _chunked ? CHUNKED_HEADER : CLOSE_HEADER);
+		}
+		//Spaces before the line break are optional whitespace of the header value
+		slot[strlen(slot)] = ' ';
+		uint8_t headerEnd = _chunked ? HEADER_SLOT_SIZE - CHUNK_SIZE_LINE_SIZE : HEADER_SLOT_SIZE;
+		memcpy(&slot[headerEnd - 4], "\r\n\r\n", 4);
+		if (_chunked) writeChunkSize(size, &slot[headerEnd]);
+	}
+
+	w5500.writeSnTX_WR(_socket, _slot);
+	w5500.send_data_processing(_socket, (uint8_t*)slot, _slotSize);
+	w5500.writeSnTX_WR(_socket, end);
+	_slotSize = 0;
+	return size;
+}
+
+/**
+	Sends the data staged in the network card with a single send command and
+	waits until the network card has sent it. The last part of a chunked body
+	is followed by the last chunk.
+
+	@param last: True if the response ends with the staged data
+*/
+void HttpResponse::send(bool last)
+{
+	if (_staged == 0) return;
+
+	if (_slotSize > 0) {
+		bool lastChunk = last && _chunked;
+		uint16_t size = fillSlot(last);
+		//An empty last part is the last chunk itself, "000"
+		if (lastChunk) w5500.send_data_processing(_socket, (const uint8_t*)LAST_CHUNK, size > 0 ? LAST_CHUNK_SIZE : 2);
+	}
+	_staged = 0;
+
+	w5500.execCmdSn(_socket, Sock_SEND);
+	while ((w5500.readSnIR(_socket) & SnIR::SEND_OK) != SnIR::SEND_OK) {
+		if (w5500.readSnSR(_socket) == SnSR::CLOSED) return;
+	}
+	w5500.writeSnIR(_socket, SnIR::SEND_OK);
+}
+
+/**
+	Waits until the client has acknowledged enough of the sent data.
+
+	@param size: Bytes needed in the transmit buffer
+	@return Free bytes in the transmit buffer, less than size if the connection was lost
+*/
+uint16_t HttpResponse::waitForRoom(uint16_t size)
+{
+	uint16_t room;
+	do {
+		room = w5500.getTXFreeSize(_socket);
+		uint8_t status = w5500.readSnSR(_socket);
+		if (status != SnSR::ESTABLISHED && status != SnSR::CLOSE_WAIT) return 0;
+	} while (room < size);
+	return room;
+}
@@ -0,0 +1,63 @@
+#ifndef HttpResponse_h
+#define HttpResponse_h
+
+#define RESPONSE_BUFFER_SIZE 64 //Collects small writes to one SPI transfer, does not limit the size of a send
+
+#include <Print.h>
+#include "HTTP.hpp"
+
+/**
+	Streams a HTTP-response to the client. Writes are collected to a small buffer,
+	which is copied to the socket's 2 KB transmit buffer in the network card whenever
+	it fills up. The response is sent with a single send when it ends, so a response
+	that fits the network card goes out in one segment train instead of one send per
+	buffer. Status line and headers are written when the body is first written or the
+	response ends, followed by a slot for the framing header. A response that fits the
+	free transmit buffer gets a Content-Length. A larger one is sent in parts, with chunked
+	transfer encoding on a persistent connection, otherwise its body ends when the connection
+	is closed. A handler that cannot answer yet may defer the response instead of writing it.
+*/
+class HttpResponse : public Print
+{
+public:
+
+	HttpResponse();
+
+	void begin(uint8_t socket, bool keepAlive);
+	void setStatus(HTTPResponseType type);
+	void defer(unsigned long context = 0);
+	void resume(unsigned long context);
+	bool isDeferred() const;
+	unsigned long getContext() const;
+	size_t write(uint8_t c);
+	size_t write(const uint8_t* buffer, size_t size);
+	bool end();
+
+	using Print::write;
+
+private:
+
+	uint8_t _socket;
+	HTTPResponseType _status;
+	bool _keepAlive;
+	bool _headersSent;
+	bool _chunked;
+	bool _deferred;
+	unsigned long _context;
+	uint8_t _buffer[RESPONSE_BUFFER_SIZE];
+	uint8_t _length;
+	uint8_t _slotSize; //Size of the reserved framing slot, 0 if none is reserved
+	uint16_t _slot; //Transmit buffer pointer of the slot
+	uint16_t _room; //Free bytes in the network card's transmit buffer after the staged data
+	uint16_t _staged; //Bytes copied to the network card but not yet sent
+
+	void sendHeaders();
+	void flush();
+	bool makeRoom(uint16_t size);
+	void reserveSlot(uint8_t size);
+	uint16_t fillSlot(bool last);
+	void send(bool last);
+	uint16_t waitForRoom(uint16_t size);
+};
+
+#endif
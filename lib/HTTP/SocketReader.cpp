@@ -0,0 +1,51 @@
+#include "SocketReader.hpp"
+
+
+SocketReader::SocketReader()
+: _length(0), _position(0)
+{
+}
+
+/**
+	Replaces buffer content with data pending in the client's receive buffer.
+	Reads as much as fits to the buffer with a single read.
+
+	@param client: EthernetClient to read from
+	@return Number of bytes read, 0 if no data was available
+*/
+int SocketReader::fill(EthernetClient& client)
+{
+	int received = client.read(_buffer, sizeof(_buffer));
+	_length = received > 0 ? received : 0;
+	_position = 0;
+	return _length;
+}
+
+/**
+	@return True if there are unread characters in the buffer.
+*/
+bool SocketReader::available() const
+{
+	return _position < _length;
+}
+
+/**
+	Reads next character from the buffer. Check available() first.
+
+	@return Next character
+*/
+char SocketReader::read()
+{
+	return _buffer[_position++];
+}
+
+/**
+	Drops unread characters from the buffer and from the client's receive buffer.
+
+	@param client: EthernetClient whose pending data is discarded
+*/
+void SocketReader::discard(EthernetClient& client)
+{
+	while (fill(client) > 0);
+	_length = _position = 0;
+}
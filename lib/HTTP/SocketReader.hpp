@@ -0,0 +1,30 @@
+#ifndef SocketReader_h
+#define SocketReader_h
+
+#define SOCKET_READER_BUFFER_SIZE 64
+
+#include <EthernetClient.h>
+
+/**
+	Copies received data from the network card to RAM in bursts, so data can be
+	consumed one character at a time without a SPI-transaction per character.
+*/
+class SocketReader
+{
+public:
+
+	SocketReader();
+
+	int fill(EthernetClient& client);
+	bool available() const;
+	char read();
+	void discard(EthernetClient& client);
+
+private:
+
+	uint8_t _buffer[SOCKET_READER_BUFFER_SIZE];
+	uint8_t _length;
+	uint8_t _position;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "OneWireEngine.hpp"
+
+#define MATCH_ROM 0x55
+
+OneWireEngine::OneWireEngine()
+: _wire(nullptr), _operations(), _values(), _length(0), _position(0), _buffer(), _bufferLength(0), _present(false)
+{
+}
+
+/**
+	Starts queueing a new transaction. The previous transaction must be finished.
+
+	@param wire: Bus of the transaction
+*/
+void OneWireEngine::begin(OneWire& wire)
+{
+	_wire = &wire;
+	_length = 0;
+	_position = 0;
+	_bufferLength = 0;
+	_present = false;
+}
+
+/**
+	Queues a reset pulse. If the first reset of the transaction gets no
+	presence pulse, the rest of the transaction is skipped.
+
+	@return false if the queue is full
+*/
+bool OneWireEngine::reset()
+{
+	return add(OneWireOperation::RESET, 0);
+}
+
+/**
+	Queues writing a byte.
+
+	@param value: Byte to write
+	@return false if the queue is full
+*/
+bool OneWireEngine::write(uint8_t value)
+{
+	return add(OneWireOperation::WRITE, value);
+}
+
+/**
+	Queues Match ROM command with device address, every byte as its own operation.
+
+	@param address: 8 byte address of the device
+	@return false if the queue is full
+*/
+bool OneWireEngine::select(const uint8_t* address)
+{
+	if (_length + 9 > ONEWIRE_QUEUE_LENGTH) return false;
+
+	write(MATCH_ROM);
+	for (uint8_t i=0; i<8; i++) {
+		write(address[i]);
+	}
+	return true;
+}
+
+/**
+	Queues reading bytes to the data buffer. Each byte is read by its own step.
+
+	@param count: Number of bytes to read
+	@return false if the queue is full or the bytes do not fit to the buffer
+*/
+bool OneWireEngine::read(uint8_t count)
+{
+	if (count == 0) return true;
+
+	uint8_t queued = 0;
+	for (uint8_t i=_position; i<_length; i++) {
+		if (_operations[i] == OneWireOperation::READ) queued += _values[i];
+	}
+	if (queued + count > ONEWIRE_BUFFER_SIZE) return false;
+	return add(OneWireOperation::READ, count);
+}
+
+/**
+	Runs the next byte of the transaction.
+
+	@return true if the transaction has more operations
+*/
+bool OneWireEngine::step()
+{
+	if (!isBusy()) return false;
+
+	uint8_t& value = _values[_position];
+	switch (_operations[_position]) {
+		case OneWireOperation::RESET:
+			if (_position == 0) {
+				_present = _wire->reset();
+				//Nobody is listening
+				if (!_present) _position = _length;
+			} else {
+				_wire->reset();
+			}
+			break;
+		case OneWireOperation::WRITE:
+			_wire->write(value);
+			break;
+		case OneWireOperation::READ:
+			_buffer[_bufferLength++] = _wire->read();
+			//Stay at the same operation until all bytes are read
+			if (--value > 0) return true;
+			break;
+	}
+	if (_position < _length) _position++;
+	return isBusy();
+}
+
+/**
+	Runs the rest of the transaction at once. Must be called before using the bus
+	directly, a transaction cannot be interrupted by other traffic.
+*/
+void OneWireEngine::finish()
+{
+	while (step());
+}
+
+bool OneWireEngine::isBusy()
+{
+	return _position < _length;
+}
+
+/**
+	@return true if a device answered the first reset of the transaction
+*/
+bool OneWireEngine::isPresent()
+{
+	return _present;
+}
+
+const uint8_t* OneWireEngine::getData()
+{
+	return _buffer;
+}
+
+uint8_t OneWireEngine::getDataLength()
+{
+	return _bufferLength;
+}
+
+bool OneWireEngine::add(OneWireOperation operation, uint8_t value)
+{
+	if (_length >= ONEWIRE_QUEUE_LENGTH) return false;
+
+	_operations[_length] = operation;
+	_values[_length] = value;
+	_length++;
+	return true;
+}
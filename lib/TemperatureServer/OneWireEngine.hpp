@@ -0,0 +1,52 @@
+#ifndef OneWireEngine_h
+#define OneWireEngine_h
+
+#define ONEWIRE_QUEUE_LENGTH 16 //Enough for match ROM and 6 more operations
+#define ONEWIRE_BUFFER_SIZE 9 //Whole scratchpad
+
+#include <OneWire.h>
+
+enum class OneWireOperation : uint8_t
+{
+	RESET,
+	WRITE,
+	READ
+};
+
+/**
+	Runs a queued 1-Wire transaction one byte at a time, so other tasks can
+	be run between the bytes instead of waiting for the whole transaction.
+*/
+class OneWireEngine {
+private:
+	OneWire* _wire;
+	OneWireOperation _operations[ONEWIRE_QUEUE_LENGTH];
+	uint8_t _values[ONEWIRE_QUEUE_LENGTH];
+	uint8_t _length;
+	uint8_t _position;
+	uint8_t _buffer[ONEWIRE_BUFFER_SIZE];
+	uint8_t _bufferLength;
+	bool _present;
+
+	bool add(OneWireOperation operation, uint8_t value);
+
+public:
+
+	OneWireEngine();
+
+	void begin(OneWire& wire);
+	bool reset();
+	bool write(uint8_t value);
+	bool select(const uint8_t* address);
+	bool read(uint8_t count);
+
+	bool step();
+	void finish();
+	bool isBusy();
+
+	bool isPresent();
+	const uint8_t* getData();
+	uint8_t getDataLength();
+};
+
+#endif
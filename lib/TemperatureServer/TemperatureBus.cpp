@@ -0,0 +1,205 @@
+#include "TemperatureBus.hpp"
+
+#define WRITE_SCRATCHPAD 0x4E
+#define READ_SCRATCHPAD 0xBE
+#define POWER_ON_RAW 10880 //85 degrees Celsius in 1/128 degrees
+#define MIN_RAW -7040 //-55 degrees Celsius
+#define MAX_RAW 16000 //125 degrees Celsius
+
+#define SCRATCHPAD_SIZE 9
+#define TEMP_LSB 0
+#define TEMP_MSB 1
+#define COUNT_REMAIN 6
+#define COUNT_PER_C 7
+#define SCRATCHPAD_CRC 8
+
+TemperatureBus::TemperatureBus(int pin)
+: _pin(pin), _wire(pin), _sensors(&_wire), _resolution(0), _conversionResolution(0), _converting(false), _conversionStarted(0)
+{
+}
+
+/**
+	Initializes the sensors on the bus. Conversions are not waited for, they are
+	checked with isConversionComplete instead.
+*/
+void TemperatureBus::begin()
+{
+	_sensors.begin();
+	_sensors.setWaitForConversion(false);
+}
+
+/**
+	Starts temperature conversion on all sensors of the bus without waiting for it to finish.
+*/
+void TemperatureBus::startConversion()
+{
+	_sensors.requestTemperatures();
+	_conversionResolution = _resolution;
+	_conversionStarted = millis();
+	_converting = true;
+}
+
+/**
+	Starts temperature conversion on a single sensor without waiting for it to finish.
+	The conversion is waited only as long as the sensor's own resolution needs.
+
+	@param address: Address of the sensor
+	@param resolution: Resolution of the sensor
+	@return false if the sensor did not respond
+*/
+bool TemperatureBus::startConversion(const uint8_t* address, uint8_t resolution)
+{
+	if (!_sensors.requestTemperaturesByAddress(address)) return false;
+	_conversionResolution = resolution;
+	_conversionStarted = millis();
+	_converting = true;
+	return true;
+}
+
+/**
+	Checks if the conversion started by startConversion has finished. Sensors are
+	polled on the bus unless they use parasite power, which only allows waiting
+	for the worst case conversion time of the highest resolution converting.
+
+	@return True if temperatures can be read
+*/
+bool TemperatureBus::isConversionComplete()
+{
+	if (millis() - _conversionStarted >= (unsigned long)_sensors.millisToWaitForConversion(_conversionResolution)) {
+		return true;
+	}
+	return !_sensors.isParasitePowerMode() && _sensors.isConversionComplete();
+}
+
+/**
+	Marks the conversion read.
+*/
+void TemperatureBus::finishConversion()
+{
+	_converting = false;
+}
+
+bool TemperatureBus::isConverting()
+{
+	return _converting;
+}
+
+/**
+	Queues reading the sensor's scratchpad to the engine. A fast read reads only
+	the two temperature bytes and ends the read with a reset, instead of reading
+	all nine bytes for the CRC check. Fast read works only with sensors having
+	a 12-bit temperature register, not with DS18S20.
+
+	@param engine: Engine running the transaction
+	@param address: Address of the sensor
+	@param fast: true to read only the temperature bytes
+*/
+void TemperatureBus::queueRead(OneWireEngine& engine, const uint8_t* address, bool fast)
+{
+	engine.begin(_wire);
+	engine.reset();
+	engine.select(address);
+	engine.write(READ_SCRATCHPAD);
+	if (fast) {
+		engine.read(2);
+		engine.reset();
+	} else {
+		engine.read(SCRATCHPAD_SIZE);
+	}
+}
+
+/**
+	Gets the temperature of a finished fast read. Readings that are not plausible
+	without the CRC are rejected: all ones from a sensor that stopped responding,
+	the 85 degree power-on value and values out of the sensor's range. The caller
+	should then do a full read.
+
+	@param engine: Engine that ran the fast read
+	@return raw temperature in 1/128 degrees Celsius, DEVICE_DISCONNECTED_RAW if rejected
+*/
+int16_t TemperatureBus::getFastTemperature(OneWireEngine& engine)
+{
+	const uint8_t* data = engine.getData();
+	if (!engine.isPresent() || engine.getDataLength() < 2) return DEVICE_DISCONNECTED_RAW;
+	if (data[TEMP_LSB] == 0xFF && data[TEMP_MSB] == 0xFF) return DEVICE_DISCONNECTED_RAW;
+
+	//Same conversion as DallasTemperature::calculateTemperature
+	int16_t raw = (((int16_t)data[TEMP_MSB]) << 11) | (((int16_t)data[TEMP_LSB]) << 3);
+	if (raw == POWER_ON_RAW || raw < MIN_RAW || raw > MAX_RAW) return DEVICE_DISCONNECTED_RAW;
+	return raw;
+}
+
+/**
+	Gets the temperature of a finished full read after checking the scratchpad CRC.
+
+	@param engine: Engine that ran the read
+	@param address: Address of the sensor
+	@return raw temperature in 1/128 degrees Celsius, DEVICE_DISCONNECTED_RAW if the read failed
+*/
+int16_t TemperatureBus::getTemperature(OneWireEngine& engine, const uint8_t* address)
+{
+	const uint8_t* data = engine.getData();
+	if (!engine.isPresent() || engine.getDataLength() < SCRATCHPAD_SIZE) return DEVICE_DISCONNECTED_RAW;
+	if (OneWire::crc8(data, SCRATCHPAD_SIZE - 1) != data[SCRATCHPAD_CRC]) return DEVICE_DISCONNECTED_RAW;
+
+	//Same conversion as DallasTemperature::calculateTemperature
+	int16_t raw = (((int16_t)data[TEMP_MSB]) << 11) | (((int16_t)data[TEMP_LSB]) << 3);
+	if (address[0] == DS18S20MODEL) {
+		raw = ((raw & 0xfff0) << 3) - 16 + (((data[COUNT_PER_C] - data[COUNT_REMAIN]) << 7) / data[COUNT_PER_C]);
+	}
+	return raw;
+}
+
+/**
+	Queues writing alarm thresholds to the sensor's scratchpad. Unlike DallasTemperature's
+	setHighAlarmTemp and setLowAlarmTemp, the scratchpad is not copied to EEPROM,
+	so re-arming does not wear the EEPROM or wait for the copy to finish.
+
+	@param engine: Engine running the transaction
+	@param address: Address of the sensor
+	@param low: Low alarm threshold in degrees Celsius
+	@param high: High alarm threshold in degrees Celsius
+	@param resolution: Resolution of the sensor, written to the configuration register
+*/
+void TemperatureBus::queueAlarms(OneWireEngine& engine, const uint8_t* address, int8_t low, int8_t high, uint8_t resolution)
+{
+	engine.begin(_wire);
+	engine.reset();
+	engine.select(address);
+	engine.write(WRITE_SCRATCHPAD);
+	engine.write(high);
+	engine.write(low);
+	//DS18S20 has no configuration register
+	if (address[0] != DS18S20MODEL) engine.write(((resolution - 9) << 5) | 0x1F);
+	engine.reset();
+}
+
+/**
+	Sets the resolution conversions on the bus are waited for.
+
+	@param resolution: Highest resolution of the sensors on the bus
+*/
+void TemperatureBus::setResolution(uint8_t resolution)
+{
+	_resolution = resolution;
+}
+
+uint8_t TemperatureBus::getResolution()
+{
+	return _resolution;
+}
+
+int TemperatureBus::getPin()
+{
+	return _pin;
+}
+
+OneWire& TemperatureBus::getWire()
+{
+	return _wire;
+}
+
+DallasTemperature& TemperatureBus::getSensors()
+{
+	return _sensors;
+}
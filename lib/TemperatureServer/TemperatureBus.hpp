@@ -0,0 +1,41 @@
+#ifndef TemperatureBus_h
+#define TemperatureBus_h
+
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include "OneWireEngine.hpp"
+
+class TemperatureBus {
+private:
+	int _pin;
+	OneWire _wire;
+	DallasTemperature _sensors;
+	uint8_t _resolution;
+	uint8_t _conversionResolution;
+	bool _converting;
+	unsigned long _conversionStarted;
+
+public:
+
+	TemperatureBus(int pin);
+
+	void begin();
+	void startConversion();
+	bool startConversion(const uint8_t* address, uint8_t resolution);
+	bool isConversionComplete();
+	void finishConversion();
+	bool isConverting();
+
+	void queueRead(OneWireEngine& engine, const uint8_t* address, bool fast);
+	int16_t getFastTemperature(OneWireEngine& engine);
+	int16_t getTemperature(OneWireEngine& engine, const uint8_t* address);
+	void queueAlarms(OneWireEngine& engine, const uint8_t* address, int8_t low, int8_t high, uint8_t resolution);
+
+	void setResolution(uint8_t resolution);
+	uint8_t getResolution();
+	int getPin();
+	OneWire& getWire();
+	DallasTemperature& getSensors();
+};
+
+#endif
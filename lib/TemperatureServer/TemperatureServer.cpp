@@ -1,132 +1,1210 @@
 #include "TemperatureServer.hpp"
 #include "HTTP.hpp"
 
-#define JSON_BUFFER_SIZE 300 //Enough for 4 temperaturesensors
 #define UPDATE_TEMPS_PATH F("updatetemps")
 #define UPDATE_SENSORS_PATH F("updatesensors")
+#define HISTORY_PATH F("history")
+#define AGGREGATES_PATH F("aggregates")
+#define CONFIG_PATH F("config")
+#define SINCE_PARAMETER F("since")
+#define MAXAGE_PARAMETER F("maxage")
+#define INTERVAL_PARAMETER F("interval")
+#define ID_PARAMETER F("id")
+#define RESOLUTION_PARAMETER F("resolution")
+#define DEADBAND_PARAMETER F("deadband")
+#define ALARMS_PARAMETER F("alarms")
+#define FAST_READ_PARAMETER F("fastread")
+#define ALARM_WINDOW_PARAMETER F("alarmwindow")
 
-#define ID_ATTRIBUTE F("id")
-#define TEMPERATURE_ATTRIBUTE F("temperature")
+//Bucket lengths of aggregate tiers in ms
+const unsigned long AGGREGATE_INTERVALS[AGGREGATE_TIERS] PROGMEM = {10000, 60000, 3600000};
 
 
-TemperatureServer::TemperatureServer(int sensorPin)
-:bus(sensorPin), sensors(&bus)
+TemperatureServer::TemperatureServer()
+:_buses{}, _busCount(0), _engine(), _state(ConversionState::IDLE), _updateRequested(true),
+_discovering(false), _discoveryBus(0),
+_fastRead(false), _alarmMode(false), _alarmWindow(DEFAULT_ALARM_WINDOW), _fullRead(true), _lastFullRead(0),
+_readingBus(false), _readBus(0), _readIndex(-1), _alarmsOnly(false), _operation(SensorOperation::FULL_READ),
+_singleSensor(-1), _sequence(0), _deadband(0),
+_lastUpdate(0), _updateCount(0), _sensors{}, _sensorCount(0),
+_historySequence(0), _lastSample(0),
+_aggregateSequence{}
 {
-	sensors.begin();
-	updateTemperatures();
+}
+
+/**
+	Adds 1-Wire bus to the server and searches for its sensors. The whole bus
+	is searched at once, so buses should be added in setup.
+
+	@param bus: Temperature bus, must exist as long as the server
+	@return true if adding the bus was successful, otherwise false
+*/
+bool TemperatureServer::addBus(TemperatureBus& bus)
+{
+	if (_busCount >= MAX_BUS_COUNT) return false;
+
+	_buses[_busCount] = &bus;
+	bus.begin();
+	searchBus(_busCount++);
+	updateResolution();
+	_updateRequested = true;
+	return true;
+}
+
+/**
+	Starts temperature conversions and reads finished conversions to the cache
+	without waiting for the sensors. Intended to call run-method from the main-loop.
+*/
+void TemperatureServer::run()
+{
+	switch (_state) {
+		case ConversionState::IDLE:
+			//Single sensor reads are waiting for a response, so they go first
+			if (startSingleConversion()) break;
+
+			if (_updateRequested || millis() - _lastUpdate >= TEMPERATURE_UPDATE_INTERVAL) {
+				startConversion();
+			} else if (_discovering) {
+				discoverNextSensor();
+			}
+			break;
+		case ConversionState::CONVERTING:
+			if (!readTemperatures()) {
+				finishUpdate();
+			}
+			break;
+		case ConversionState::CONVERTING_SINGLE:
+			if (!readSingleTemperature()) {
+				_sensors[_singleSensor].singleRead = SingleReadState::DONE;
+				_singleSensor = -1;
+				_state = ConversionState::IDLE;
+			}
+			break;
+	}
 }
 
 /**
 	Handles HTTP-request. If does not recognize request path and/or method, sends 404 Not found.
 
 	@param request: First line of a HTTP-request
-	@param client: Client to which the response is sent
+	@param response: Response to the client
 */
-void TemperatureServer::handleRequest(const String &request, EthernetClient &client)
+void TemperatureServer::handleRequest(const HttpRequest &request, HttpResponse& response)
 {
-	String path = HTTP::parseRequestPath(request, 2);
-	HTTPMethod method = HTTP::getRequestMethod(request);
+	const char* path = request.getPathSegment(2);
+	HTTPMethod method = request.getMethod();
 
-	if (method == HTTPMethod::GET && path.length() < 1) return getTemperatures(client);
-	else if (path.equals(UPDATE_TEMPS_PATH) && method == HTTPMethod::PUT) return updateTemperatures(client);
-	else if (path.equals(UPDATE_SENSORS_PATH) && method == HTTPMethod::PUT) return updateSensors(client);
+	if (method == HTTPMethod::GET && strlen(path) < 1) {
+		if (request.getParameter(ID_PARAMETER)) return getTemperature(request, response);
+		if (request.getParameter(SINCE_PARAMETER)) return getChangedTemperatures(request, response);
+		return getTemperatures(response);
+	}
+	else if (method == HTTPMethod::PUT && strlen(path) < 1) return setResolution(request, response);
+	else if (request.isPath(2, HISTORY_PATH) && method == HTTPMethod::GET) return getHistory(request, response);
+	else if (request.isPath(2, AGGREGATES_PATH) && method == HTTPMethod::GET) return getAggregates(request, response);
+	else if (request.isPath(2, CONFIG_PATH) && method == HTTPMethod::GET) return getConfig(response);
+	else if (request.isPath(2, CONFIG_PATH) && method == HTTPMethod::PUT) return setConfig(request, response);
+	else if (request.isPath(2, UPDATE_TEMPS_PATH) && method == HTTPMethod::PUT) return updateTemperatures(response);
+	else if (request.isPath(2, UPDATE_SENSORS_PATH) && method == HTTPMethod::PUT) return updateSensors(response);
 
-	HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_404_NOT_FOUND);
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_404_NOT_FOUND);
 }
 
 /**
-	Updates temperatures of all sensors and sends 204 No content response to client when done.
+	Continues a deferred update or single sensor read. The context is the update
+	count the request waits for, or the sensor index with SINGLE_READ_CONTEXT set.
 
-	@param client: Client to which the response is sent
+	@param response: Response to the client
 */
-void TemperatureServer::updateTemperatures(EthernetClient& client)
+void TemperatureServer::resumeRequest(HttpResponse& response)
 {
-	updateTemperatures();
-	HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_204_NO_CONTENT);
+	unsigned long context = response.getContext();
+	if (context & SINGLE_READ_CONTEXT) return sendSingleRead(context & ~SINGLE_READ_CONTEXT, response);
+	sendUpdated(context, response);
 }
 
 /**
-	Searches for new temperature sensors and sends 204 No content response to client when done.
+	Requests temperature update from all sensors and sends 204 No content response to client
+	when the update has finished. Requests coalesce: a request joins the conversion already
+	running or requested, and an update finished less than UPDATE_FRESHNESS ago answers
+	right away, so only one conversion is done however many clients ask.
+	In alarm mode all sensors are read.
 
-	@param client: Client to which the response is sent
+	@param response: Response to the client
 */
-void TemperatureServer::updateSensors(EthernetClient& client)
+void TemperatureServer::updateTemperatures(HttpResponse& response)
 {
-	updateSensors();
-	HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_204_NO_CONTENT);
+	if (_state == ConversionState::IDLE && !_updateRequested && _updateCount > 0 &&
+		millis() - _lastUpdate < UPDATE_FRESHNESS) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_204_NO_CONTENT);
+	}
+	//Running conversion is joined, otherwise the next one is requested. Both finish as the next update.
+	if (_state != ConversionState::CONVERTING) _updateRequested = true;
+	disarmAlarms();
+	sendUpdated(_updateCount + 1, response);
 }
 
 /**
-	Updates temperatures and sends them in JSON-format to client.
+	Sends 204 No content response to client if an update has finished, otherwise defers the response.
 
-	@param client: Client to which the response is sent
+	@param updateCount: Value of _updateCount the request waits for
+	@param response: Response to the client
 */
-void TemperatureServer::getTemperatures(EthernetClient& client)
+void TemperatureServer::sendUpdated(unsigned long updateCount, HttpResponse& response)
 {
-	updateTemperatures();
-	StaticJsonBuffer<JSON_BUFFER_SIZE> jsonBuffer;
-	JsonArray& root = jsonBuffer.createArray();
+	if ((long)(_updateCount - updateCount) < 0) return response.defer(updateCount);
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_204_NO_CONTENT);
+}
+
+/**
+	Starts searching for new and removed temperature sensors and sends 204 No content
+	response to client. The search is done in the background by run().
+
+	@param response: Response to the client
+*/
+void TemperatureServer::updateSensors(HttpResponse& response)
+{
+	startDiscovery();
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_204_NO_CONTENT);
+}
 
-	for (int i=0; i<sensors.getDeviceCount(); i++) {
-		JsonObject& tempSensor = root.createNestedObject();
-		char id[64] = "";
-		getID(i, id);
-		tempSensor[ID_ATTRIBUTE] = id;
-		tempSensor[TEMPERATURE_ATTRIBUTE] = getTemperature(i);
+/**
+	Sends cached temperatures in JSON-format to client. Age of each reading is in milliseconds.
+
+	@param response: Response to the client
+*/
+void TemperatureServer::getTemperatures(HttpResponse& response)
+{
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
+	printTemperatures(response, 0);
+}
+
+/**
+	Sends cached temperatures of the sensors whose temperature has changed more than
+	the deadband after the given sequence number, together with the current sequence
+	number in JSON-format to client. If since is greater than the current sequence,
+	the server has been restarted and all temperatures are sent.
+
+	Parameters:
+	since: Sequence number of the previous response
+
+	@param request: First line of a HTTP-request
+	@param response: Response to the client
+*/
+void TemperatureServer::getChangedTemperatures(const HttpRequest& request, HttpResponse& response)
+{
+	long since;
+	if (request.getParameter(SINCE_PARAMETER, since) != ParameterResult::VALID || since < 0) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
 	}
-	HTTP::sendHttpResponse(client, HTTPResponseType::HTTP_200_OK);
-	root.printTo(client);
+	if ((unsigned long)since > _sequence) since = 0;
+
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
+	response.print(F("{\"sequence\":"));
+	response.print(_sequence);
+	response.print(F(",\"temperatures\":"));
+	printTemperatures(response, since);
+	response.print('}');
 }
 
 /**
-	Updates temperatures of all sensors.
+	Prints cached temperatures as a JSON-array.
+
+	@param out: Print where the array is written
+	@param since: Only sensors whose temperature changed after this sequence number are printed
 */
-void TemperatureServer::updateTemperatures()
+void TemperatureServer::printTemperatures(Print& out, unsigned long since)
 {
-	sensors.requestTemperatures();
+	bool first = true;
+
+	out.print('[');
+	for (int i=0; i<_sensorCount; i++) {
+		TemperatureSensor& sensor = _sensors[i];
+		if (!sensor.hasReading || sensor.sequence <= since) continue;
+
+		if (!first) out.print(',');
+		printTemperature(out, sensor);
+		first = false;
+	}
+	out.print(']');
 }
 
 /**
-	Searches for new temperature sensors.
+	Prints cached temperature of a sensor as a JSON-object. Age of the reading is in milliseconds.
+
+	@param out: Print where the object is written
+	@param sensor: Sensor whose temperature is printed
 */
-void TemperatureServer::updateSensors()
+void TemperatureServer::printTemperature(Print& out, const TemperatureSensor& sensor)
 {
-	sensors.begin();
+	char temperature[TEMPERATURE_STRING_LENGTH];
+	formatTemperature(sensor.temperature, temperature);
+	char id[SENSOR_ID_LENGTH + 1];
+	getSensorId(sensor.address, id);
+
+	out.print(F("{\"id\":\""));
+	out.print(id);
+	out.print(F("\",\"temperature\":"));
+	out.print(temperature);
+	out.print(F(",\"age\":"));
+	out.print(millis() - sensor.readTime);
+	out.print(F(",\"resolution\":"));
+	out.print(sensor.resolution);
+	out.print('}');
 }
 
 /**
-	Rounds value to tenths.
+	Reads temperature of a single sensor and sends it in JSON-format to client. Only
+	the requested sensor converts its temperature, so the response is as fast as its
+	resolution allows. The response is deferred until the conversion has been read.
+	If the sensor is not found, sends 400 Bad request response to the client.
+
+	Parameters:
+	id: ID of the sensor
 
-	@param value: float value to be rounded
-	@return rounded float-value
+	@param request: First line of a HTTP-request
+	@param response: Response to the client
 */
-float TemperatureServer::roundTemp(float value)
+void TemperatureServer::getTemperature(const HttpRequest& request, HttpResponse& response)
 {
-	return floor(value * 5 + 0.5) / 5;
+	TemperatureSensor* sensor = findSensor(request.getParameter(ID_PARAMETER));
+	if (!sensor) return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	sendSingleRead(sensor - _sensors, response);
 }
 
 /**
-	Get temperature from single temperature sensor.
+	Sends the temperature of a single read to client if it has been read,
+	otherwise requests the read and defers the response.
 
-	@param index: Index of the temperature sensor, index > 0
-	@return temperature in float rounded to tenths
+	@param index: Index of the sensor in _sensors
+	@param response: Response to the client
 */
-float TemperatureServer::getTemperature(int index)
+void TemperatureServer::sendSingleRead(uint8_t index, HttpResponse& response)
 {
-	return roundTemp(sensors.getTempCByIndex(index));
+	TemperatureSensor& sensor = _sensors[index];
+
+	//Result of a read requested earlier may belong to a client that has gone
+	if (sensor.singleRead == SingleReadState::DONE && millis() - sensor.readTime > SINGLE_READ_MAX_AGE) {
+		sensor.singleRead = SingleReadState::NONE;
+	}
+	if (sensor.singleRead != SingleReadState::DONE) {
+		if (sensor.singleRead == SingleReadState::NONE) sensor.singleRead = SingleReadState::REQUESTED;
+		return response.defer(SINGLE_READ_CONTEXT | index);
+	}
+	sensor.singleRead = SingleReadState::NONE;
+
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
+	printTemperature(response, sensor);
+}
+
+/**
+	Sets resolution of a single sensor or all sensors on the bus and sends cached
+	temperatures to the client. If resolution is missing or invalid or sensor is
+	not found, sends 400 Bad request response to the client.
+
+	Parameters:
+	resolution: Resolution in bits, from 9 to 12
+	id: ID of the sensor (optional), if missing resolution is set to all sensors
+
+	@param request: First line of a HTTP-request
+	@param response: Response to the client
+*/
+void TemperatureServer::setResolution(const HttpRequest& request, HttpResponse& response)
+{
+	int resolution;
+	if (request.getParameter(RESOLUTION_PARAMETER, resolution) != ParameterResult::VALID || resolution < MIN_RESOLUTION || resolution > MAX_RESOLUTION) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	}
+
+	const char* id = request.getParameter(ID_PARAMETER);
+	if (id) {
+		TemperatureSensor* sensor = findSensor(id);
+		if (!sensor) return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+		setResolution(*sensor, resolution);
+	} else {
+		for (int i=0; i<_sensorCount; i++) {
+			setResolution(_sensors[i], resolution);
+		}
+	}
+	updateResolution();
+	_updateRequested = true;
+	getTemperatures(response);
+}
+
+/**
+	Sends temperature server configuration in JSON-format to client.
+
+	@param response: Response to the client
+*/
+void TemperatureServer::getConfig(HttpResponse& response)
+{
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
+	response.print(F("{\"fastread\":"));
+	response.print(_fastRead ? F("true") : F("false"));
+	response.print(F(",\"alarms\":"));
+	response.print(_alarmMode ? F("true") : F("false"));
+	response.print(F(",\"alarmwindow\":"));
+	response.print(_alarmWindow);
+	response.print(F(",\"deadband\":"));
+	response.print(_deadband);
+	response.print('}');
+}
+
+/**
+	Sets temperature server configuration and sends it in JSON-format to client.
+	If a parameter is invalid, nothing is changed and 400 Bad request is sent to the client.
+
+	Optional parameters:
+	fastread: 1 to read only the temperature bytes of sensors, 0 to read the whole scratchpad
+	alarms: 1 to read only sensors whose temperature left the alarm window, 0 to read all sensors
+	alarmwindow: Degrees from 1 to 10 the temperature may change before the sensor is read
+	deadband: Tenths of a degree from 0 to 50 the temperature may change before it is sent to since-requests
+
+	@param request: First line of a HTTP-request
+	@param response: Response to the client
+*/
+void TemperatureServer::setConfig(const HttpRequest& request, HttpResponse& response)
+{
+	//Missing parameters keep their current values
+	int fastRead = _fastRead, alarms = _alarmMode, alarmWindow = _alarmWindow, deadband = _deadband;
+
+	if (request.getParameter(FAST_READ_PARAMETER, fastRead) == ParameterResult::INVALID ||
+		request.getParameter(ALARMS_PARAMETER, alarms) == ParameterResult::INVALID ||
+		request.getParameter(ALARM_WINDOW_PARAMETER, alarmWindow) == ParameterResult::INVALID ||
+		request.getParameter(DEADBAND_PARAMETER, deadband) == ParameterResult::INVALID ||
+		(fastRead != 0 && fastRead != 1) ||
+		(alarms != 0 && alarms != 1) ||
+		alarmWindow < 1 || alarmWindow > MAX_ALARM_WINDOW ||
+		deadband < 0 || deadband > MAX_DEADBAND) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	}
+
+	_fastRead = fastRead;
+	_alarmMode = alarms;
+	_alarmWindow = alarmWindow;
+	_deadband = deadband;
+	disarmAlarms();
+	getConfig(response);
 }
 
 /**
-	Gets temperature sensor ID from single sensor.
+	Sends stored temperature history in JSON-format to client. Temperatures of
+	each sample are in the same order as ids, null if the sensor was not yet found.
+	Sample age is in milliseconds from the time the sample was due, samples are due
+	every HISTORY_INTERVAL from the first update. The sequence of the response is the sequence
+	number of the latest sample, so it can be given as since to the next request.
+	If since is greater than it, the server has restarted and all samples are sent.
+	A malformed or negative since or maxage is answered with 400 Bad request.
 
-	@param index: Index of the temperature sensor, index > 0
-	@param outStr: char* to buffer where the ID is stored
+	Optional parameters:
+	since: Only samples with a greater sequence number are sent
+	maxage: Only samples younger than maxage seconds are sent
+
+	@param request: First line of a HTTP-request
+	@param response: Response to the client
 */
-void TemperatureServer::getID(int index, char* outStr)
+void TemperatureServer::getHistory(const HttpRequest& request, HttpResponse& response)
 {
-	byte address[8];
-	sensors.getAddress(address, index);
-	array_to_string(address, sizeof(address), outStr);
+	unsigned long now = millis();
+	unsigned long first = _historySequence > HISTORY_LENGTH ? _historySequence - HISTORY_LENGTH + 1 : 1;
+	long since, maxAge;
+
+	ParameterResult sinceResult = request.getParameter(SINCE_PARAMETER, since);
+	ParameterResult maxAgeResult = request.getParameter(MAXAGE_PARAMETER, maxAge);
+	if (sinceResult == ParameterResult::INVALID || maxAgeResult == ParameterResult::INVALID ||
+		(sinceResult == ParameterResult::VALID && since < 0) || (maxAgeResult == ParameterResult::VALID && maxAge < 0)) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	}
+	//A sequence ahead of the history is from before a restart, all samples are sent
+	if (sinceResult == ParameterResult::MISSING || (unsigned long)since > _historySequence) since = 0;
+	if ((unsigned long)since >= first) first = since + 1;
+	if (maxAgeResult == ParameterResult::MISSING) maxAge = -1;
+
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
+
+	//Written directly to the response, the history does not fit to a JSON-buffer
+	response.print(F("{\"sequence\":"));
+	response.print(_historySequence);
+	response.print(F(",\"ids\":"));
+	printIds(response);
+	response.print(F(",\"samples\":["));
+
+	char temperature[TEMPERATURE_STRING_LENGTH];
+	bool firstSample = true;
+	for (unsigned long sequence=first; sequence<=_historySequence; sequence++) {
+		uint8_t index = sequence % HISTORY_LENGTH;
+		unsigned long age = now - _lastSample + (_historySequence - sequence) * HISTORY_INTERVAL;
+		if (maxAge >= 0 && age / 1000 > (unsigned long)maxAge) continue;
+
+		if (!firstSample) response.print(',');
+		response.print(F("{\"sequence\":"));
+		response.print(sequence);
+		response.print(F(",\"age\":"));
+		response.print(age);
+		response.print(F(",\"temperatures\":["));
+		for (int i=0; i<_sensorCount; i++) {
+			if (i > 0) response.print(',');
+			if (sequence >= _sensors[i].historyStart) {
+				formatTemperature(_sensors[i].history[index], temperature);
+				response.print(temperature);
+			} else {
+				response.print(F("null"));
+			}
+		}
+		response.print(F("]}"));
+		firstSample = false;
+	}
+	response.print(F("]}"));
+}
+
+/**
+	Sends minimum, maximum and mean temperatures of each aggregate tier in JSON-format
+	to client. Values of each bucket are in the same order as ids, null if the sensor
+	had no readings during the bucket. Bucket age is in milliseconds since its end.
+
+	Optional parameters:
+	interval: Only the tier with given bucket length in seconds is sent
+
+	@param request: First line of a HTTP-request
+	@param response: Response to the client
+*/
+void TemperatureServer::getAggregates(const HttpRequest& request, HttpResponse& response)
+{
+	unsigned long now = millis();
+	long interval;
+	ParameterResult intervalResult = request.getParameter(INTERVAL_PARAMETER, interval);
+	if (intervalResult == ParameterResult::INVALID) {
+		return HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_400_BAD_REQUEST);
+	}
+	bool allTiers = intervalResult == ParameterResult::MISSING;
+
+	HTTP::sendHttpResponse(response, HTTPResponseType::HTTP_200_OK);
+
+	response.print(F("{\"ids\":"));
+	printIds(response);
+	response.print(F(",\"tiers\":["));
+
+	bool firstTier = true;
+	for (uint8_t tier=0; tier<AGGREGATE_TIERS; tier++) {
+		unsigned long tierInterval = getAggregateInterval(tier) / 1000;
+		if (!allTiers && (unsigned long)interval != tierInterval) continue;
+
+		if (!firstTier) response.print(',');
+		response.print(F("{\"interval\":"));
+		response.print(tierInterval);
+		response.print(F(",\"buckets\":["));
+
+		unsigned long sequence = _aggregateSequence[tier];
+		unsigned long first = sequence > AGGREGATE_LENGTH ? sequence - AGGREGATE_LENGTH : 0;
+		for (unsigned long i=first; i<sequence; i++) {
+			uint8_t index = i % AGGREGATE_LENGTH;
+			if (i > first) response.print(',');
+			response.print(F("{\"age\":"));
+			response.print(now - getBucketEnd(tier, i));
+			response.print(F(",\"min\":"));
+			printBucketValues(response, tier, index, &TemperatureBucket::min);
+			response.print(F(",\"max\":"));
+			printBucketValues(response, tier, index, &TemperatureBucket::max);
+			response.print(F(",\"mean\":"));
+			printBucketValues(response, tier, index, &TemperatureBucket::mean);
+			response.print('}');
+		}
+		response.print(F("]}"));
+		firstTier = false;
+	}
+	response.print(F("]}"));
+}
+
+/**
+	Prints IDs of all sensors as a JSON-array.
+
+	@param out: Where the array is printed
+*/
+void TemperatureServer::printIds(Print& out)
+{
+	char id[SENSOR_ID_LENGTH + 1];
+	out.print('[');
+	for (int i=0; i<_sensorCount; i++) {
+		getSensorId(_sensors[i].address, id);
+		if (i > 0) out.print(',');
+		out.print('"');
+		out.print(id);
+		out.print('"');
+	}
+	out.print(']');
+}
+
+/**
+	Prints one value of an aggregate bucket of all sensors as a JSON-array.
+
+	@param out: Where the array is printed
+	@param tier: Aggregate tier of the bucket
+	@param index: Index of the bucket in the tier
+	@param value: Printed member of the bucket
+*/
+void TemperatureServer::printBucketValues(Print& out, uint8_t tier, uint8_t index, int16_t TemperatureBucket::* value)
+{
+	char temperature[TEMPERATURE_STRING_LENGTH];
+	out.print('[');
+	for (int i=0; i<_sensorCount; i++) {
+		const TemperatureBucket& bucket = _sensors[i].aggregates[tier].buckets[index];
+		if (i > 0) out.print(',');
+		if (bucket.mean > DEVICE_DISCONNECTED_RAW) {
+			formatTemperature(bucket.*value, temperature);
+			out.print(temperature);
+		} else {
+			out.print(F("null"));
+		}
+	}
+	out.print(']');
+}
+
+/**
+	Starts temperature conversion on all buses without waiting for it to finish.
+*/
+void TemperatureServer::startConversion()
+{
+	for (uint8_t i=0; i<_busCount; i++) {
+		_buses[i]->startConversion();
+	}
+	//In alarm mode all sensors are still read now and then to refresh small changes
+	_fullRead = !_alarmMode || millis() - _lastFullRead >= ALARM_FULL_READ_INTERVAL;
+	if (_fullRead) _lastFullRead = millis();
+	_updateRequested = false;
+	_state = ConversionState::CONVERTING;
+}
+
+/**
+	Continues reading the converted temperatures. Each call runs only one byte of
+	a 1-Wire transaction, so the main-loop keeps running while sensors are read.
+	Buses are read one at a time in the order their conversions finish, so buses
+	with faster conversions are read while the others are still converting.
+
+	@return false if all buses have been read
+*/
+bool TemperatureServer::readTemperatures()
+{
+	if (_engine.isBusy()) {
+		_engine.step();
+		return true;
+	}
+	if (_readingBus) {
+		finishOperation();
+		return true;
+	}
+
+	bool converting = false;
+	for (uint8_t i=0; i<_busCount; i++) {
+		TemperatureBus& bus = *_buses[i];
+		if (!bus.isConverting()) continue;
+
+		if (bus.isConversionComplete()) {
+			startReadingBus(i);
+			return true;
+		}
+		converting = true;
+	}
+	return converting;
+}
+
+/**
+	Starts reading converted temperatures of a bus. In alarm mode only sensors
+	whose temperature left their alarm window are read and re-armed.
+
+	@param bus: Index of the bus in _buses
+*/
+void TemperatureServer::startReadingBus(uint8_t bus)
+{
+	_readingBus = true;
+	_readBus = bus;
+	_readIndex = -1;
+	//Alarm search would reset the search state of a running discovery
+	_alarmsOnly = !_fullRead && !_discovering;
+	if (_alarmsOnly) searchAlarms(bus);
+	readNextSensor();
+}
+
+/**
+	Starts reading the next sensor of the bus being read. When all sensors
+	of the bus have been read, the bus is ready for a new conversion.
+*/
+void TemperatureServer::readNextSensor()
+{
+	while (_state == ConversionState::CONVERTING && ++_readIndex < _sensorCount) {
+		TemperatureSensor& sensor = _sensors[_readIndex];
+		if (sensor.bus != _readBus || (_alarmsOnly && sensor.armed)) continue;
+
+		bool fast = _fastRead && sensor.address[0] != DS18S20MODEL;
+		startRead(sensor, fast ? SensorOperation::FAST_READ : SensorOperation::FULL_READ);
+		return;
+	}
+	_buses[_readBus]->finishConversion();
+	_readingBus = false;
+}
+
+/**
+	Handles the result of the finished transaction of the sensor being read.
+	A rejected fast read is done again in full and a read sensor is re-armed in alarm mode,
+	otherwise the next sensor is read.
+*/
+void TemperatureServer::finishOperation()
+{
+	TemperatureSensor& sensor = _sensors[_readIndex];
+	TemperatureBus& bus = *_buses[_readBus];
+	int16_t raw;
+
+	switch (_operation) {
+		case SensorOperation::FAST_READ:
+			raw = bus.getFastTemperature(_engine);
+			if (raw == DEVICE_DISCONNECTED_RAW) return startRead(sensor, SensorOperation::FULL_READ);
+			storeTemperature(sensor, raw);
+			break;
+		case SensorOperation::FULL_READ:
+			storeTemperature(sensor, bus.getTemperature(_engine, sensor.address));
+			break;
+		case SensorOperation::ARM:
+			sensor.armed = true;
+			break;
+	}
+	if (!_engine.isBusy()) readNextSensor();
+}
+
+/**
+	Stores new reading of a sensor to the cache. In alarm mode the sensor's alarm window
+	is moved around the new reading.
+
+	@param sensor: Temperature sensor that was read
+	@param raw: Temperature in 1/128 degrees Celsius, DEVICE_DISCONNECTED_RAW if the read failed
+*/
+void TemperatureServer::storeTemperature(TemperatureSensor& sensor, int16_t raw)
+{
+	//Deadband in 1/128 degrees, a sensor appearing or disappearing is always a change
+	int16_t deadband = _deadband * 128 / 10;
+	bool connectionChanged = (raw > DEVICE_DISCONNECTED_RAW) != (sensor.reportedTemperature > DEVICE_DISCONNECTED_RAW);
+	if (!sensor.hasReading || connectionChanged || abs(raw - sensor.reportedTemperature) > deadband) {
+		sensor.reportedTemperature = raw;
+		sensor.sequence = ++_sequence;
+	}
+	sensor.temperature = raw;
+	sensor.readTime = millis();
+	sensor.hasReading = true;
+	sensor.present = raw > DEVICE_DISCONNECTED_RAW;
+	if (_alarmMode && sensor.present) armAlarm(sensor);
+}
+
+/**
+	Queues a transaction for the sensor to the 1-Wire engine.
+
+	@param sensor: Temperature sensor to read
+	@param operation: Fast or full read of the temperature
+*/
+void TemperatureServer::startRead(const TemperatureSensor& sensor, SensorOperation operation)
+{
+	_operation = operation;
+	_buses[sensor.bus]->queueRead(_engine, sensor.address, operation == SensorOperation::FAST_READ);
+}
+
+/**
+	Searches the bus for sensors with alarm flag set and marks them to be read.
+
+	@param bus: Index of the bus in _buses
+*/
+void TemperatureServer::searchAlarms(uint8_t bus)
+{
+	OneWire& wire = _buses[bus]->getWire();
+	DeviceAddress address;
+
+	wire.reset_search();
+	while (wire.search(address, false)) {
+		TemperatureSensor* sensor = findSensor(address);
+		if (sensor) sensor->armed = false;
+	}
+}
+
+/**
+	Queues setting the sensor's alarm window around its cached temperature. The sensor
+	compares only whole degrees, so the window is set around the integer part.
+	The sensor is marked armed when the transaction has finished.
+
+	@param sensor: Temperature sensor to arm
+*/
+void TemperatureServer::armAlarm(TemperatureSensor& sensor)
+{
+	int degrees = sensor.temperature >> 7;
+	int8_t low = constrain(degrees - _alarmWindow, -55, 125);
+	int8_t high = constrain(degrees + _alarmWindow, -55, 125);
+
+	_operation = SensorOperation::ARM;
+	_buses[sensor.bus]->queueAlarms(_engine, sensor.address, low, high, sensor.resolution);
+}
+
+/**
+	Marks all sensors to be read and re-armed after the next conversion.
+*/
+void TemperatureServer::disarmAlarms()
+{
+	for (int i=0; i<_sensorCount; i++) {
+		_sensors[i].armed = false;
+	}
+}
+
+/**
+	Starts conversion on the first sensor whose single read has been requested.
+
+	@return false if no single read was requested
+*/
+bool TemperatureServer::startSingleConversion()
+{
+	_singleSensor = -1;
+	for (int i=0; i<_sensorCount && _singleSensor < 0; i++) {
+		if (_sensors[i].singleRead == SingleReadState::REQUESTED) _singleSensor = i;
+	}
+	if (_singleSensor < 0) return false;
+
+	TemperatureSensor& sensor = _sensors[_singleSensor];
+	sensor.singleRead = SingleReadState::CONVERTING;
+	_state = ConversionState::CONVERTING_SINGLE;
+	if (!_buses[sensor.bus]->startConversion(sensor.address, sensor.resolution)) {
+		//Answer with the failed reading instead of waiting
+		storeTemperature(sensor, DEVICE_DISCONNECTED_RAW);
+	}
+	return true;
+}
+
+/**
+	Continues reading the sensor converting with startSingleConversion, one byte per call.
+
+	@return false when the sensor has been read
+*/
+bool TemperatureServer::readSingleTemperature()
+{
+	if (_engine.isBusy()) {
+		_engine.step();
+		return true;
+	}
+	if (_readingBus) {
+		finishOperation();
+		return _readingBus;
+	}
+
+	TemperatureSensor& sensor = _sensors[_singleSensor];
+	TemperatureBus& bus = *_buses[sensor.bus];
+	if (!bus.isConverting()) return false;
+	if (!bus.isConversionComplete()) return true;
+
+	_readingBus = true;
+	_readBus = sensor.bus;
+	_readIndex = _singleSensor;
+	_alarmsOnly = false;
+	bool fast = _fastRead && sensor.address[0] != DS18S20MODEL;
+	startRead(sensor, fast ? SensorOperation::FAST_READ : SensorOperation::FULL_READ);
+	return true;
+}
+
+/**
+	Finishes the update after all buses have been read and stores the new temperatures to history and aggregates.
+*/
+void TemperatureServer::finishUpdate()
+{
+	_lastUpdate = millis();
+	_updateCount++;
+	_state = ConversionState::IDLE;
+
+	//A sample is taken for every interval that has passed, so sample times stay on the grid
+	while (_historySequence == 0 || _lastUpdate - _lastSample >= HISTORY_INTERVAL) {
+		recordHistory();
+	}
+	aggregateTemperatures();
+}
+
+/**
+	Stores the cached temperatures of all sensors as the next sample of the history
+	ring buffers. Samples are numbered from 1, so sequence 0 means no samples.
+*/
+void TemperatureServer::recordHistory()
+{
+	_historySequence++;
+	uint8_t index = _historySequence % HISTORY_LENGTH;
+	for (int i=0; i<_sensorCount; i++) {
+		_sensors[i].history[index] = _sensors[i].temperature;
+	}
+	//Later samples are due on a fixed interval from the first, so their times need not be stored
+	_lastSample = _historySequence == 1 ? _lastUpdate : _lastSample + HISTORY_INTERVAL;
+}
+
+/**
+	Adds the cached temperatures to the first aggregate tier and closes the buckets
+	of each tier whose end has passed. A closed bucket is added to the next tier,
+	so every reading is handled only once per tier.
+*/
+void TemperatureServer::aggregateTemperatures()
+{
+	for (int i=0; i<_sensorCount; i++) {
+		TemperatureSensor& sensor = _sensors[i];
+		if (sensor.temperature <= DEVICE_DISCONNECTED_RAW) continue;
+		addToAggregate(sensor.aggregates[0], sensor.temperature, sensor.temperature, sensor.temperature, 1);
+	}
+
+	//Buckets end on a fixed grid from startup, a bucket is closed for every end that has passed
+	for (uint8_t tier=0; tier<AGGREGATE_TIERS; tier++) {
+		while ((long)(_lastUpdate - getBucketEnd(tier, _aggregateSequence[tier])) >= 0) {
+			closeBucket(tier);
+		}
+	}
+}
+
+/**
+	Adds readings to the open bucket of an aggregate tier.
+
+	@param aggregate: Aggregate tier of a sensor
+	@param min: Lowest of the added readings
+	@param max: Highest of the added readings
+	@param sum: Sum of the added readings
+	@param count: Number of the added readings
+*/
+void TemperatureServer::addToAggregate(TemperatureAggregate& aggregate, int16_t min, int16_t max, long sum, uint16_t count)
+{
+	if (aggregate.count == 0 || min < aggregate.min) aggregate.min = min;
+	if (aggregate.count == 0 || max > aggregate.max) aggregate.max = max;
+	aggregate.sum += sum;
+	aggregate.count += count;
+}
+
+/**
+	Stores the open bucket of a tier for all sensors, adds it to the next tier and starts a new bucket.
+
+	@param tier: Aggregate tier to close
+*/
+void TemperatureServer::closeBucket(uint8_t tier)
+{
+	uint8_t index = _aggregateSequence[tier] % AGGREGATE_LENGTH;
+	for (int i=0; i<_sensorCount; i++) {
+		TemperatureAggregate& aggregate = _sensors[i].aggregates[tier];
+		TemperatureBucket& bucket = aggregate.buckets[index];
+
+		if (aggregate.count > 0) {
+			long half = aggregate.count / 2;
+			bucket.min = aggregate.min;
+			bucket.max = aggregate.max;
+			bucket.mean = (aggregate.sum + (aggregate.sum >= 0 ? half : -half)) / (long)aggregate.count;
+			if (tier + 1 < AGGREGATE_TIERS) {
+				addToAggregate(_sensors[i].aggregates[tier + 1], aggregate.min, aggregate.max, aggregate.sum, aggregate.count);
+			}
+		} else {
+			bucket.mean = DEVICE_DISCONNECTED_RAW;
+		}
+		aggregate.sum = 0;
+		aggregate.count = 0;
+	}
+	_aggregateSequence[tier]++;
+}
+
+/**
+	Discards all aggregated temperatures of a sensor.
+
+	@param sensor: Temperature sensor whose aggregates are cleared
+*/
+void TemperatureServer::clearAggregates(TemperatureSensor& sensor)
+{
+	for (uint8_t tier=0; tier<AGGREGATE_TIERS; tier++) {
+		TemperatureAggregate& aggregate = sensor.aggregates[tier];
+		aggregate.sum = 0;
+		aggregate.count = 0;
+		for (uint8_t i=0; i<AGGREGATE_LENGTH; i++) {
+			aggregate.buckets[i].mean = DEVICE_DISCONNECTED_RAW;
+		}
+	}
+}
+
+/**
+	@param tier: Aggregate tier
+	@return length of the tier's buckets in ms
+*/
+unsigned long TemperatureServer::getAggregateInterval(uint8_t tier)
+{
+	return pgm_read_dword(&AGGREGATE_INTERVALS[tier]);
+}
+
+/**
+	Calculates the end of a bucket, so the times of the buckets need not be stored.
+	Wraps around with millis().
+
+	@param tier: Aggregate tier
+	@param sequence: Number of the bucket in the tier, starting from 0
+	@return millis() when the bucket ends
+*/
+unsigned long TemperatureServer::getBucketEnd(uint8_t tier, unsigned long sequence)
+{
+	return (sequence + 1) * getAggregateInterval(tier);
+}
+
+/**
+	Searches for temperature sensors on a bus and adds them to _sensors, so the
+	bus does not have to be searched again on every read. A sensor already found
+	on another bus is skipped, so IDs stay unique across buses.
+
+	@param busIndex: Index of the bus in _buses
+*/
+void TemperatureServer::searchBus(uint8_t busIndex)
+{
+	OneWire& wire = _buses[busIndex]->getWire();
+	DallasTemperature& sensors = _buses[busIndex]->getSensors();
+	DeviceAddress address;
+
+	wire.reset_search();
+	while (_sensorCount < MAX_SENSOR_COUNT && wire.search(address)) {
+		if (!sensors.validAddress(address) || !sensors.validFamily(address)) continue;
+		if (findSensor(address)) continue;
+		addSensor(address, busIndex);
+	}
+}
+
+/**
+	Starts searching all buses for new and removed sensors. The search is
+	continued by discoverNextSensor one sensor at a time.
+*/
+void TemperatureServer::startDiscovery()
+{
+	if (_busCount == 0) return;
+
+	for (int i=0; i<_sensorCount; i++) {
+		_sensors[i].seen = false;
+	}
+	_discoveryBus = 0;
+	_buses[0]->getWire().reset_search();
+	_discovering = true;
+}
+
+/**
+	Searches for the next sensor on the bus under discovery. Known sensors are only
+	marked as seen, new sensors are added to _sensors. When all buses have been
+	searched, sensors that were not found are marked missing.
+*/
+void TemperatureServer::discoverNextSensor()
+{
+	TemperatureBus& bus = *_buses[_discoveryBus];
+	DallasTemperature& sensors = bus.getSensors();
+	DeviceAddress address;
+
+	if (!bus.getWire().search(address)) {
+		//Bus searched through, continue with the next one
+		if (++_discoveryBus < _busCount) {
+			_buses[_discoveryBus]->getWire().reset_search();
+		} else {
+			finishDiscovery();
+		}
+		return;
+	}
+	if (!sensors.validAddress(address) || !sensors.validFamily(address)) return;
+
+	TemperatureSensor* sensor = findSensor(address);
+	if (sensor) {
+		sensor->seen = true;
+		return;
+	}
+	if (!addSensor(address, _discoveryBus)) return;
+
+	//Parasite power mode is only detected by DallasTemperature's own search,
+	//which also resets the discovery of this bus
+	if (!sensors.isParasitePowerMode() && sensors.readPowerSupply(address)) {
+		sensors.begin();
+		bus.getWire().reset_search();
+	}
+	updateResolution();
+	_updateRequested = true;
+}
+
+/**
+	Marks sensors that were not found during the discovery missing.
+*/
+void TemperatureServer::finishDiscovery()
+{
+	for (int i=0; i<_sensorCount; i++) {
+		TemperatureSensor& sensor = _sensors[i];
+		if (sensor.seen) continue;
+		sensor.present = false;
+		sensor.temperature = DEVICE_DISCONNECTED_RAW;
+		if (sensor.reportedTemperature > DEVICE_DISCONNECTED_RAW) {
+			sensor.reportedTemperature = DEVICE_DISCONNECTED_RAW;
+			sensor.sequence = ++_sequence;
+		}
+	}
+	_discovering = false;
+}
+
+/**
+	Adds sensor to _sensors and reads its resolution. If _sensors is full,
+	the slot of a missing sensor is used.
+
+	@param address: Address of the new sensor
+	@param busIndex: Index of the sensor's bus in _buses
+	@return Pointer to the added sensor, nullptr if there is no room for it
+*/
+TemperatureSensor* TemperatureServer::addSensor(const uint8_t* address, uint8_t busIndex)
+{
+	TemperatureSensor* sensor = nullptr;
+	if (_sensorCount < MAX_SENSOR_COUNT) {
+		sensor = &_sensors[_sensorCount++];
+	} else {
+		for (int i=0; i<_sensorCount && !sensor; i++) {
+			if (!_sensors[i].present) sensor = &_sensors[i];
+		}
+		if (!sensor) return nullptr;
+	}
+
+	//History of the slot belongs to another sensor
+	if (memcmp(sensor->address, address, sizeof(DeviceAddress)) != 0) {
+		sensor->historyStart = _historySequence + 1;
+		clearAggregates(*sensor);
+	}
+	memcpy(sensor->address, address, sizeof(DeviceAddress));
+	sensor->bus = busIndex;
+	sensor->resolution = _buses[busIndex]->getSensors().getResolution(address);
+	sensor->present = true;
+	sensor->seen = true;
+	sensor->armed = false;
+	sensor->singleRead = SingleReadState::NONE;
+	sensor->sequence = 0;
+	sensor->hasReading = false;
+	return sensor;
+}
+
+/**
+	Finds address of a known sensor.
+
+	@param id: ID of the sensor, case insensitive
+	@param address: Address of the sensor, "Output variable". Unchanged if not found.
+	@return True if the sensor was found
+*/
+bool TemperatureServer::getSensorAddress(const char* id, uint8_t* address)
+{
+	TemperatureSensor* sensor = findSensor(id);
+	if (!sensor) return false;
+	memcpy(address, sensor->address, sizeof(DeviceAddress));
+	return true;
+}
+
+/**
+	Formats ID of a sensor from its address. The sensor does not need to be known.
+
+	@param address: Address of the sensor
+	@param buffer: Buffer of at least SENSOR_ID_LENGTH + 1 chars
+*/
+void TemperatureServer::getSensorId(const uint8_t* address, char buffer[])
+{
+	array_to_string(address, sizeof(DeviceAddress), buffer);
+}
+
+/**
+	Gets the cached temperature of a sensor without reading the sensor.
+
+	@param address: Address of the sensor
+	@param raw: Temperature in 1/128 degrees Celsius, "Output variable"
+	@param readTime: millis() when the temperature was read, "Output variable"
+	@return false if the sensor is unknown, missing or has no valid reading
+*/
+bool TemperatureServer::getCachedTemperature(const uint8_t* address, int16_t& raw, unsigned long& readTime)
+{
+	TemperatureSensor* sensor = findSensor(address);
+	if (!sensor || !sensor->present || !sensor->hasReading || sensor->temperature <= DEVICE_DISCONNECTED_RAW) return false;
+	raw = sensor->temperature;
+	readTime = sensor->readTime;
+	return true;
+}
+
+/**
+	Finds sensor from _sensors by its ID.
+
+	@param id: ID of the sensor, case insensitive
+	@return Pointer to the sensor, nullptr if not found
+*/
+TemperatureSensor* TemperatureServer::findSensor(const char* id)
+{
+	char sensorId[SENSOR_ID_LENGTH + 1];
+	for (int i=0; i<_sensorCount; i++) {
+		getSensorId(_sensors[i].address, sensorId);
+		if (strcasecmp(sensorId, id) == 0) return &_sensors[i];
+	}
+	return nullptr;
+}
+
+/**
+	Finds sensor from _sensors by its address.
+
+	@param address: Address of the sensor
+	@return Pointer to the sensor, nullptr if not found
+*/
+TemperatureSensor* TemperatureServer::findSensor(const uint8_t* address)
+{
+	for (int i=0; i<_sensorCount; i++) {
+		if (memcmp(_sensors[i].address, address, sizeof(DeviceAddress)) == 0) return &_sensors[i];
+	}
+	return nullptr;
+}
+
+/**
+	Writes new resolution to the sensor's scratchpad and EEPROM. Sensors without
+	configurable resolution keep their own, so the resolution is read back from the sensor.
+
+	@param sensor: Temperature sensor to configure
+	@param resolution: Resolution in bits, from 9 to 12
+*/
+void TemperatureServer::setResolution(TemperatureSensor& sensor, uint8_t resolution)
+{
+	if (sensor.resolution == resolution) return;
+	//A transaction of the 1-Wire engine cannot be interrupted
+	_engine.finish();
+	DallasTemperature& sensors = _buses[sensor.bus]->getSensors();
+	sensors.setResolution(sensor.address, resolution, true);
+	sensor.resolution = sensors.getResolution(sensor.address);
+	sensor.armed = false;
+}
+
+/**
+	Updates the resolution of each bus to the highest resolution in use on it,
+	so conversions are waited only as long as the slowest sensor of the bus needs.
+*/
+void TemperatureServer::updateResolution()
+{
+	for (uint8_t bus=0; bus<_busCount; bus++) {
+		uint8_t resolution = 0;
+		for (int i=0; i<_sensorCount; i++) {
+			if (_sensors[i].bus == bus) resolution = max(resolution, _sensors[i].resolution);
+		}
+		_buses[bus]->setResolution(resolution);
+	}
+}
+
+/**
+	Converts raw temperature to decimal string rounded to the nearest 0.2 degrees
+	using integer math only. Disconnected sensors are shown as -127.
+
+	@param raw: temperature in 1/128 degrees Celsius
+	@param buffer: char array of TEMPERATURE_STRING_LENGTH where the string is stored
+*/
+void TemperatureServer::formatTemperature(int16_t raw, char buffer[])
+{
+	if (raw <= DEVICE_DISCONNECTED_RAW) {
+		strcpy_P(buffer, PSTR("-127"));
+		return;
+	}
+
+	//Fifths of a degree, rounded half up
+	long fifths = (long)raw * 5 + 64;
+	fifths = fifths >= 0 ? fifths / 128 : -((-fifths + 127) / 128);
+
+	if (fifths < 0) {
+		*buffer++ = '-';
+		fifths = -fifths;
+	}
+	uint8_t tenths = (fifths % 5) * 2;
+	itoa(fifths / 5, buffer, 10);
+	if (tenths > 0) {
+		buffer += strlen(buffer);
+		*buffer++ = '.';
+		*buffer++ = '0' + tenths;
+		*buffer = '\0';
+	}
 }
 
 /**
@@ -136,7 +1214,7 @@ void TemperatureServer::getID(int index, char* outStr)
 	@param len: unsigned int number of elements in array
 	@param outBuffer: char array where the string representation is stored
 */
-void TemperatureServer::array_to_string(byte array[], unsigned int len, char outBuffer[])
+void TemperatureServer::array_to_string(const byte array[], unsigned int len, char outBuffer[])
 {
 	for (unsigned int i = 0; i < len; i++) {
 		byte nib1 = (array[i] >> 4) & 0x0F;
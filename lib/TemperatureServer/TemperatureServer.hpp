@@ -2,35 +2,178 @@
 #define TemperatureServer_h
 
 #define TEMPERATURE_SERVER_PATH F("temperatures")
+#define MAX_SENSOR_COUNT 4
+#define MAX_BUS_COUNT 2
+#define TEMPERATURE_UPDATE_INTERVAL 5000 //ms between automatic conversions
+#define UPDATE_FRESHNESS 1000 //ms a finished update answers update requests without a new conversion
+#define SENSOR_ID_LENGTH 16
+#define MIN_RESOLUTION 9
+#define MAX_RESOLUTION 12
+#define DEFAULT_ALARM_WINDOW 1 //Degrees around the last reading before a sensor is read in alarm mode
+#define MAX_ALARM_WINDOW 10
+#define ALARM_FULL_READ_INTERVAL 60000 //ms between reading all sensors in alarm mode
+#define MAX_DEADBAND 50 //Tenths of a degree
+#define SINGLE_READ_MAX_AGE 1000 //ms a finished single sensor read is kept for its request
+#define SINGLE_READ_CONTEXT 0x80000000UL //Set in the context of a deferred single read, other bits are the sensor index
+#define HISTORY_LENGTH 12 //Samples stored per sensor
+#define HISTORY_INTERVAL 60000 //ms between samples stored to history
+#define AGGREGATE_TIERS 3 //10 seconds, 1 minute and 1 hour
+#define AGGREGATE_LENGTH 1 //Buckets stored per tier, limited by RAM
+#define TEMPERATURE_STRING_LENGTH 7 //"-127.0"
 
-#include <OneWire.h>
-#include <DallasTemperature.h>
-#include <EthernetClient.h>
-#include <ArduinoJson.h>
 #include "ArduinoServerInterface.hpp"
+#include "TemperatureBus.hpp"
+
+enum class ConversionState
+{
+	IDLE,
+	CONVERTING,
+	CONVERTING_SINGLE
+};
+
+enum class SingleReadState : uint8_t
+{
+	NONE,
+	REQUESTED,
+	CONVERTING,
+	DONE
+};
+
+enum class SensorOperation
+{
+	FAST_READ,
+	FULL_READ,
+	ARM
+};
+
+struct TemperatureBucket
+{
+	int16_t min;
+	int16_t max;
+	int16_t mean; //DEVICE_DISCONNECTED_RAW if there were no readings
+};
+
+struct TemperatureAggregate
+{
+	int16_t min;
+	int16_t max;
+	long sum;
+	uint16_t count;
+	TemperatureBucket buckets[AGGREGATE_LENGTH];
+};
+
+struct TemperatureSensor
+{
+	DeviceAddress address;
+	uint8_t bus; //Index in _buses
+	uint8_t resolution;
+	bool present; //False if the sensor did not respond or was not found by the last discovery
+	bool seen; //Found by the running discovery
+	bool armed; //Alarm window is set around the cached temperature
+	SingleReadState singleRead; //State of a read requested with GET /temperatures?id=
+	bool hasReading;
+	int16_t temperature; //Raw value in 1/128 degrees Celsius
+	unsigned long readTime;
+	int16_t reportedTemperature; //Raw value when sequence was last changed
+	unsigned long sequence; //Value of _sequence when the temperature last changed more than the deadband
+	unsigned long historyStart; //Sequence number of the first history sample of this sensor
+	int16_t history[HISTORY_LENGTH];
+	TemperatureAggregate aggregates[AGGREGATE_TIERS];
+};
 
 class TemperatureServer : public ArduinoServerInterface
 {
 public:
 
-	TemperatureServer(int sensorPin);
+	TemperatureServer();
 
-	void handleRequest(const String& request, EthernetClient& client);
-	void updateTemperatures(EthernetClient& client);
-	void updateSensors(EthernetClient& client);
-	void getTemperatures(EthernetClient& client);
+	bool addBus(TemperatureBus& bus);
+	void run();
+	void handleRequest(const HttpRequest& request, HttpResponse& response);
+	void resumeRequest(HttpResponse& response);
+	void updateTemperatures(HttpResponse& response);
+	void updateSensors(HttpResponse& response);
+	void getTemperatures(HttpResponse& response);
+	void getChangedTemperatures(const HttpRequest& request, HttpResponse& response);
+	void getTemperature(const HttpRequest& request, HttpResponse& response);
+	void getHistory(const HttpRequest& request, HttpResponse& response);
+	void getAggregates(const HttpRequest& request, HttpResponse& response);
+	void setResolution(const HttpRequest& request, HttpResponse& response);
+	void getConfig(HttpResponse& response);
+	void setConfig(const HttpRequest& request, HttpResponse& response);
+
+	bool getSensorAddress(const char* id, uint8_t* address);
+	void getSensorId(const uint8_t* address, char buffer[]);
+	bool getCachedTemperature(const uint8_t* address, int16_t& raw, unsigned long& readTime);
 
 private:
 
-	OneWire bus;
-	DallasTemperature sensors;
+	TemperatureBus* _buses[MAX_BUS_COUNT];
+	uint8_t _busCount;
+	OneWireEngine _engine;
+
+	ConversionState _state;
+	bool _updateRequested;
+	bool _discovering;
+	uint8_t _discoveryBus;
+	bool _fastRead;
+	bool _alarmMode;
+	uint8_t _alarmWindow;
+	bool _fullRead;
+	unsigned long _lastFullRead;
+	bool _readingBus;
+	uint8_t _readBus;
+	int _readIndex;
+	bool _alarmsOnly;
+	SensorOperation _operation;
+	int _singleSensor;
+	unsigned long _sequence;
+	uint8_t _deadband;
+	unsigned long _lastUpdate;
+	unsigned long _updateCount; //Finished updates, pending update requests wait for a later count
+	TemperatureSensor _sensors[MAX_SENSOR_COUNT];
+	int _sensorCount;
+	unsigned long _historySequence; //Sequence number of the latest history sample
+	unsigned long _lastSample; //Due time of the latest sample, older sample times are derived from it
+	unsigned long _aggregateSequence[AGGREGATE_TIERS]; //Closed buckets of each tier, their times are derived from it
 
-	void updateTemperatures();
-	void updateSensors();
-	float roundTemp(float f);
-	float getTemperature(int index);
-	void getID(int index, char* str);
-	void array_to_string(byte array[], unsigned int len, char buffer[]);
+	void startConversion();
+	bool readTemperatures();
+	void startReadingBus(uint8_t bus);
+	void readNextSensor();
+	void finishOperation();
+	void sendUpdated(unsigned long updateCount, HttpResponse& response);
+	void sendSingleRead(uint8_t index, HttpResponse& response);
+	void storeTemperature(TemperatureSensor& sensor, int16_t raw);
+	void finishUpdate();
+	bool startSingleConversion();
+	bool readSingleTemperature();
+	void searchAlarms(uint8_t bus);
+	void armAlarm(TemperatureSensor& sensor);
+	void disarmAlarms();
+	void recordHistory();
+	void aggregateTemperatures();
+	void addToAggregate(TemperatureAggregate& aggregate, int16_t min, int16_t max, long sum, uint16_t count);
+	void closeBucket(uint8_t tier);
+	void clearAggregates(TemperatureSensor& sensor);
+	unsigned long getAggregateInterval(uint8_t tier);
+	unsigned long getBucketEnd(uint8_t tier, unsigned long sequence);
+	void printTemperatures(Print& out, unsigned long since);
+	void printTemperature(Print& out, const TemperatureSensor& sensor);
+	void printIds(Print& out);
+	void printBucketValues(Print& out, uint8_t tier, uint8_t index, int16_t TemperatureBucket::* value);
+	void searchBus(uint8_t bus);
+	void startDiscovery();
+	void discoverNextSensor();
+	void finishDiscovery();
+	TemperatureSensor* addSensor(const uint8_t* address, uint8_t bus);
+	TemperatureSensor* findSensor(const char* id);
+	TemperatureSensor* findSensor(const uint8_t* address);
+	void setResolution(TemperatureSensor& sensor, uint8_t resolution);
+	void updateResolution();
+	void startRead(const TemperatureSensor& sensor, SensorOperation operation);
+	void formatTemperature(int16_t raw, char buffer[]);
+	void array_to_string(const byte array[], unsigned int len, char buffer[]);
 
 };
 
@@ -8,13 +8,18 @@
 static 	byte mac[6]  = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
 
 HttpRequestHandler httpHandler;
-TemperatureServer tempServer(TEMPSENSOR_PIN);
-FanServer fanServer;
+TemperatureBus tempBus(TEMPSENSOR_PIN);
+TemperatureServer tempServer;
+FanServer fanServer(tempServer);
 
 
 void setup() {
+#ifdef DEBUG_SERIAL
 	Serial.begin(9600);
 	while(!Serial);
+#endif
+
+	tempServer.addBus(tempBus);
 
 	httpHandler.init(HTTP_SERVER_PORT,mac);
 	httpHandler.addRoute(FANSERVER_PATH, fanServer);
@@ -25,4 +30,6 @@ void setup() {
 void loop()
 {
 	httpHandler.run();
+	tempServer.run();
+	fanServer.run();
 }